@@ -0,0 +1,155 @@
+#pragma once
+
+#include "EngineWorkerPool.h"
+#include "ImageIO.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QString>
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Converts every image of a directory into a coloring page, one image per worker.
+class BatchProcessor {
+public:
+    struct ImageTiming {
+        QString name;
+        double loadMs = 0.0;
+        double generateMs = 0.0;
+        double saveMs = 0.0;
+        bool succeeded = false;
+        QString error;
+        QString backend;
+
+        double totalMs() const {
+            return loadMs + generateMs + saveMs;
+        }
+    };
+
+    BatchProcessor(const QString& inputDir, const QString& outputDir, int jobs, const PipelineParams& params = PipelineParams())
+        : inputDir(inputDir), outputDir(outputDir), jobs(jobs), params(params) {
+    }
+
+    // Returns the process exit code: 0 when every image was converted.
+    int run() {
+        QDir input(inputDir);
+        if (!input.exists()) {
+            std::fprintf(stderr, "Input directory does not exist: %s\n", qUtf8Printable(inputDir));
+            return 1;
+        }
+        if (!QDir().mkpath(outputDir)) {
+            std::fprintf(stderr, "Failed to create output directory: %s\n", qUtf8Printable(outputDir));
+            return 1;
+        }
+
+        QFileInfoList files = input.entryInfoList({ "*.png", "*.jpg", "*.jpeg" }, QDir::Files, QDir::Name);
+        if (files.isEmpty()) {
+            std::fprintf(stderr, "No images found in %s\n", qUtf8Printable(inputDir));
+            return 1;
+        }
+
+        // Parallelism comes from running images side by side; OpenCV's own threading
+        // would only oversubscribe the cores.
+        int previousThreads = cv::getNumThreads();
+        if (jobs > 1) {
+            cv::setNumThreads(1);
+        }
+
+        std::vector<ImageTiming> timings(files.size());
+        QElapsedTimer wallClock;
+        wallClock.start();
+        {
+            EngineWorkerPool pool(jobs);
+            for (int i = 0; i < files.size(); ++i) {
+                QString sourcePath = files[i].absoluteFilePath();
+                QString targetPath = QDir(outputDir).filePath(files[i].fileName());
+                ImageTiming* timing = &timings[i];
+                timing->name = files[i].fileName();
+                pool.submit([this, sourcePath, targetPath, timing](ColoringPageEngine& engine) {
+                    engine.setParams(params);
+                    processImage(engine, sourcePath, targetPath, *timing);
+                });
+            }
+            pool.waitForDone();
+        }
+        double wallMs = wallClock.nsecsElapsed() / 1e6;
+
+        cv::setNumThreads(previousThreads);
+
+        printSummary(timings, wallMs);
+
+        bool allSucceeded = std::all_of(timings.begin(), timings.end(), [](const ImageTiming& timing) {
+            return timing.succeeded;
+            });
+        return allSucceeded ? 0 : 2;
+    }
+
+    // Loads, converts and saves one image, recording the time of each step. Never throws.
+    static void processImage(ColoringPageEngine& engine, const QString& sourcePath, const QString& targetPath, ImageTiming& timing) {
+        QElapsedTimer timer;
+        try {
+            timer.start();
+            cv::Mat image = ImageIO::load(sourcePath);
+            timing.loadMs = timer.nsecsElapsed() / 1e6;
+            if (image.empty()) {
+                timing.error = "failed to load";
+                return;
+            }
+
+            timer.restart();
+            cv::Mat page = engine.generateColoringPage(image);
+            timing.generateMs = timer.nsecsElapsed() / 1e6;
+            timing.backend = QString::fromStdString(engine.lastProfile().backend);
+
+            timer.restart();
+            if (!ImageIO::save(targetPath, page)) {
+                timing.error = "failed to save";
+                return;
+            }
+            timing.saveMs = timer.nsecsElapsed() / 1e6;
+            timing.succeeded = true;
+        }
+        catch (cv::Exception& e) {
+            timing.error = QString::fromUtf8(e.what());
+        }
+        catch (std::exception& e) {
+            timing.error = QString::fromUtf8(e.what());
+        }
+    }
+
+private:
+    void printSummary(const std::vector<ImageTiming>& timings, double wallMs) const {
+        std::printf("%-40s %10s %10s %10s %10s\n", "image", "load ms", "gen ms", "save ms", "total ms");
+
+        double busyMs = 0.0;
+        int failures = 0;
+        QString backend = "CPU";
+        for (const ImageTiming& timing : timings) {
+            if (timing.succeeded) {
+                std::printf("%-40s %10.1f %10.1f %10.1f %10.1f\n", qUtf8Printable(timing.name),
+                    timing.loadMs, timing.generateMs, timing.saveMs, timing.totalMs());
+                backend = timing.backend;
+            }
+            else {
+                std::printf("%-40s FAILED: %s\n", qUtf8Printable(timing.name), qUtf8Printable(timing.error));
+                ++failures;
+            }
+            busyMs += timing.totalMs();
+        }
+
+        double seconds = wallMs / 1000.0;
+        std::printf("\n%d images, %d failed, %d jobs, %s\n", static_cast<int>(timings.size()), failures, jobs, qUtf8Printable(backend));
+        std::printf("wall time %.2f s, %.2f images/s, effective parallelism %.2fx\n",
+            seconds, seconds > 0.0 ? timings.size() / seconds : 0.0, wallMs > 0.0 ? busyMs / wallMs : 0.0);
+        std::fflush(stdout);
+    }
+
+    QString inputDir;
+    QString outputDir;
+    int jobs;
+    PipelineParams params;
+};
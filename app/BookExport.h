@@ -0,0 +1,283 @@
+#pragma once
+
+#include "ColoringPageEngine.h"
+#include "ImageIO.h"
+#include "MatImage.h"
+
+#include <QByteArray>
+#include <QFile>
+#include <QImageWriter>
+#include <QPageSize>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+
+#include <opencv2/opencv.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// Lays finished pages out on sheets of paper for print: every page is scaled to fill the
+// sheet inside the margins, turned a quarter when its orientation differs from the
+// paper's, and centered on white. Sheets are rendered and encoded in parallel, one page per
+// thread, and go to disk as they are done, so a book takes about as long as its slowest
+// page and never holds more than the encoded sheets waiting for their turn.
+class BookExport {
+public:
+    struct Layout {
+        QPageSize paper = QPageSize(QPageSize::A4);
+        int dpi = 300;
+        double marginInches = 0.25;
+    };
+
+    // Called on the exporting thread after each sheet is written.
+    using Progress = std::function<void(int sheetsWritten, int sheetCount)>;
+
+    // One PDF with a sheet per page, each an RGB image compressed with Flate. On failure the
+    // partial file is removed and error, when given, says why.
+    static bool savePdf(const QStringList& pagePaths, const QString& path, const Layout& layout, int jobs,
+        const Progress& progress = Progress(), QString* error = nullptr) {
+        QFile file(path);
+        if (pagePaths.isEmpty() || !file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            return fail(error, pagePaths.isEmpty() ? "No pages to export." : "Failed to open " + path);
+        }
+
+        PdfStream pdf(file, static_cast<int>(pagePaths.size()));
+        auto encode = [](const cv::Mat& sheet, int, EncodedSheet& encoded) {
+            cv::Mat rgb;
+            cv::cvtColor(sheet, rgb, cv::COLOR_BGR2RGB);
+            encoded.bytes = qCompress(rgb.data, static_cast<qsizetype>(rgb.total() * rgb.elemSize()));
+            encoded.size = sheet.size();
+            return true;
+        };
+        auto write = [&pdf, &layout](int index, const EncodedSheet& encoded) {
+            return pdf.writeSheet(index, encoded.size, layout.dpi, encoded.bytes);
+        };
+
+        bool sheetsWritten = encodeInOrder(pagePaths, layout, jobs, encode, write, progress, error);
+        bool finished = sheetsWritten && pdf.finish();
+        file.close();
+        if (!finished || file.error() != QFileDevice::NoError) {
+            file.remove();
+            return sheetsWritten ? fail(error, "Failed to write " + path) : false;
+        }
+        return true;
+    }
+
+    // One PNG per page, named prefix_001.png and up, with the layout's resolution recorded in
+    // each file. Each thread writes its own files.
+    static bool savePngs(const QStringList& pagePaths, const QString& prefix, const Layout& layout, int jobs,
+        const Progress& progress = Progress(), QString* error = nullptr) {
+        if (pagePaths.isEmpty()) {
+            return fail(error, "No pages to export.");
+        }
+
+        auto encode = [&prefix, &layout](const cv::Mat& sheet, int index, EncodedSheet& encoded) {
+            QString path = sheetPath(prefix, index);
+            QImage image = MatImage::wrap(sheet);
+            int dotsPerMeter = qRound(layout.dpi / 0.0254);
+            image.setDotsPerMeterX(dotsPerMeter);
+            image.setDotsPerMeterY(dotsPerMeter);
+            QImageWriter writer(path, "png");
+            if (!writer.write(image)) {
+                encoded.error = "Failed to write " + path;
+                return false;
+            }
+            return true;
+        };
+        auto write = [](int, const EncodedSheet&) {
+            return true;
+        };
+        return encodeInOrder(pagePaths, layout, jobs, encode, write, progress, error);
+    }
+
+    static QString sheetPath(const QString& prefix, int index) {
+        return QString("%1_%2.png").arg(prefix).arg(index + 1, 3, 10, QChar('0'));
+    }
+
+    // The sheet for one page: CV_8UC3 at the paper size in pixels at the layout's DPI.
+    static cv::Mat layOut(const cv::Mat& page, const Layout& layout) {
+        QSizeF inches = layout.paper.size(QPageSize::Inch);
+        cv::Size sheetSize(qRound(inches.width() * layout.dpi), qRound(inches.height() * layout.dpi));
+        cv::Mat sheet(sheetSize, CV_8UC3, cv::Scalar(255, 255, 255));
+
+        cv::Mat source = page;
+        if ((page.cols > page.rows) != (sheetSize.width > sheetSize.height)) {
+            cv::rotate(page, source, cv::ROTATE_90_CLOCKWISE);
+        }
+
+        int margin = qRound(layout.marginInches * layout.dpi);
+        cv::Size area(sheetSize.width - 2 * margin, sheetSize.height - 2 * margin);
+        cv::Size fitted = ColoringPageEngine::fitSize(source.size(), area);
+        if (fitted.width <= 0 || fitted.height <= 0) {
+            return sheet;
+        }
+
+        cv::Mat target = sheet(cv::Rect((sheetSize.width - fitted.width) / 2, (sheetSize.height - fitted.height) / 2, fitted.width, fitted.height));
+        int interpolation = fitted.width < source.cols ? cv::INTER_AREA : cv::INTER_LINEAR;
+        cv::resize(source, target, fitted, 0, 0, interpolation);
+        return sheet;
+    }
+
+private:
+    struct EncodedSheet {
+        cv::Size size;
+        QByteArray bytes;
+        QString error;
+        bool ready = false;
+    };
+
+    static bool fail(QString* error, const QString& message) {
+        if (error) {
+            *error = message;
+        }
+        return false;
+    }
+
+    // Loads, lays out and encodes every page on a pool of jobs threads and hands the results
+    // to write in page order on the calling thread, releasing each once written. The first
+    // failure stops the pages not started yet.
+    template <typename Encode, typename Write>
+    static bool encodeInOrder(const QStringList& pagePaths, const Layout& layout, int jobs, const Encode& encode,
+        const Write& write, const Progress& progress, QString* error) {
+        const int count = static_cast<int>(pagePaths.size());
+        std::vector<EncodedSheet> sheets(count);
+        std::mutex mutex;
+        std::condition_variable sheetReady;
+        std::atomic<bool> failed(false);
+
+        // Last, so its destructor waits for the workers before anything they use goes away.
+        QThreadPool pool;
+        pool.setMaxThreadCount(std::max(1, jobs));
+
+        for (int i = 0; i < count; ++i) {
+            QString pagePath = pagePaths[i];
+            pool.start([&, i, pagePath]() {
+                EncodedSheet encoded;
+                if (!failed) {
+                    try {
+                        cv::Mat page = ImageIO::load(pagePath);
+                        if (page.empty()) {
+                            encoded.error = "Failed to load " + pagePath;
+                        }
+                        else if (!encode(layOut(page, layout), i, encoded) && encoded.error.isEmpty()) {
+                            encoded.error = "Failed to encode " + pagePath;
+                        }
+                    }
+                    catch (cv::Exception& e) {
+                        encoded.error = QString("Failed to lay out %1: %2").arg(pagePath, e.what());
+                    }
+                }
+                else {
+                    encoded.error = "Canceled";
+                }
+
+                if (!encoded.error.isEmpty()) {
+                    failed = true;
+                }
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    sheets[i] = std::move(encoded);
+                    sheets[i].ready = true;
+                }
+                sheetReady.notify_all();
+            });
+        }
+
+        for (int i = 0; i < count; ++i) {
+            EncodedSheet encoded;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                sheetReady.wait(lock, [&sheets, i] { return sheets[i].ready; });
+                encoded = std::move(sheets[i]);
+                sheets[i] = EncodedSheet();
+            }
+
+            if (!encoded.error.isEmpty()) {
+                failed = true;
+                return fail(error, encoded.error);
+            }
+            if (!write(i, encoded)) {
+                failed = true;
+                return fail(error, QString("Failed to write page %1").arg(i + 1));
+            }
+            if (progress) {
+                progress(i + 1, count);
+            }
+        }
+        return true;
+    }
+
+    // A PDF written front to back: the catalog first, then each sheet as it arrives, and the
+    // page tree and cross-reference table at the end. Objects are numbered up front, 1 the
+    // catalog, 2 the page tree, and three per sheet: page, content stream and image.
+    class PdfStream {
+    public:
+        PdfStream(QFile& file, int sheetCount) : file(file), sheetCount(sheetCount), offsets(3 + 3 * sheetCount, 0) {
+            write("%PDF-1.4\n%\xE2\xE3\xCF\xD3\n");
+            beginObject(1);
+            write("<< /Type /Catalog /Pages 2 0 R >>\nendobj\n");
+        }
+
+        // compressed is qCompress() output: a four-byte length, then the zlib stream.
+        bool writeSheet(int index, const cv::Size& size, int dpi, const QByteArray& compressed) {
+            const int page = 3 + 3 * index;
+            const double width = size.width * 72.0 / dpi;
+            const double height = size.height * 72.0 / dpi;
+
+            beginObject(page);
+            write(QString("<< /Type /Page /Parent 2 0 R /MediaBox [0 0 %1 %2] /Resources << /XObject << /Im0 %3 0 R >> >> /Contents %4 0 R >>\nendobj\n")
+                .arg(width, 0, 'f', 2).arg(height, 0, 'f', 2).arg(page + 2).arg(page + 1).toLatin1());
+
+            QByteArray content = QString("q %1 0 0 %2 0 0 cm /Im0 Do Q").arg(width, 0, 'f', 2).arg(height, 0, 'f', 2).toLatin1();
+            beginObject(page + 1);
+            write(QString("<< /Length %1 >>\nstream\n").arg(content.size()).toLatin1());
+            write(content);
+            write("\nendstream\nendobj\n");
+
+            const qsizetype streamLength = compressed.size() - 4;
+            beginObject(page + 2);
+            write(QString("<< /Type /XObject /Subtype /Image /Width %1 /Height %2 /ColorSpace /DeviceRGB /BitsPerComponent 8 /Filter /FlateDecode /Length %3 >>\nstream\n")
+                .arg(size.width).arg(size.height).arg(streamLength).toLatin1());
+            file.write(compressed.constData() + 4, streamLength);
+            write("\nendstream\nendobj\n");
+            return file.error() == QFileDevice::NoError;
+        }
+
+        bool finish() {
+            QByteArray kids;
+            for (int i = 0; i < sheetCount; ++i) {
+                kids += QByteArray::number(3 + 3 * i) + " 0 R ";
+            }
+            beginObject(2);
+            write("<< /Type /Pages /Kids [ " + kids + "] /Count " + QByteArray::number(sheetCount) + " >>\nendobj\n");
+
+            const qint64 xref = file.pos();
+            write("xref\n0 " + QByteArray::number(static_cast<int>(offsets.size())) + "\n0000000000 65535 f \n");
+            for (size_t object = 1; object < offsets.size(); ++object) {
+                write(QString("%1 00000 n \n").arg(offsets[object], 10, 10, QChar('0')).toLatin1());
+            }
+            write("trailer\n<< /Size " + QByteArray::number(static_cast<int>(offsets.size())) + " /Root 1 0 R >>\nstartxref\n"
+                + QByteArray::number(xref) + "\n%%EOF\n");
+            return file.error() == QFileDevice::NoError;
+        }
+
+    private:
+        void beginObject(int object) {
+            offsets[object] = file.pos();
+            write(QByteArray::number(object) + " 0 obj\n");
+        }
+
+        void write(const QByteArray& bytes) {
+            file.write(bytes);
+        }
+
+        QFile& file;
+        int sheetCount;
+        std::vector<qint64> offsets;
+    };
+};
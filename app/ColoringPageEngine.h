@@ -0,0 +1,668 @@
+#pragma once
+
+#include "EdgeDetector.h"
+#include "FusedThreshold.h"
+#include "PixelKernels.h"
+#include "RectMorphology.h"
+#include "ScopedTimer.h"
+
+#include <opencv2/core/ocl.hpp>
+#include <opencv2/opencv.hpp>
+
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Tunable constants of the pipeline, grouped by the stage that first reads them.
+struct PipelineParams {
+    // Resize through closing on the OpenCL device via cv::UMat, when one is available and the
+    // page is not tiled. Falls back to the CPU otherwise.
+    bool useOpenCL = false;
+    // Grayscale + threshold through FusedThreshold instead of cvtColor + adaptiveThreshold.
+    bool fusedThreshold = false;
+    // The line extractor of the Threshold stage. Only the adaptive threshold runs tiled or
+    // on the OpenCL device; the others always see the whole page on the CPU.
+    EdgeMethod edgeMethod = EdgeMethod::AdaptiveThreshold;
+    int thresholdBlockSize = 15;
+    double thresholdC = 10.0;
+    int cannyLevels = 1;
+    double cannyLow = 40.0;
+    double cannyHigh = 120.0;
+    double xdogSigma = 1.0;
+    double xdogSharpness = 20.0;
+    double xdogThreshold = 0.3;
+    // Any format cv::dnn::readNet() reads, e.g. ONNX.
+    std::string lineArtModel;
+    int lineArtBatch = 4;
+    int closingKernelSize = 30;
+    double minContourArea = 150.0;
+    double contourEpsilon = 30.0;
+    int contourThickness = 1000;
+    int maskClosingSize = 5;
+    double gapAreaThreshold = 50.0;
+    double inpaintRadius = 3.0;
+    // Side of the square tiles the threshold and closing stages run on; 0 processes the
+    // page in one piece. The result is the same either way.
+    int tileSize = 0;
+};
+
+// Image -> coloring page pipeline, independent of any widget. An engine owns its
+// scratch buffers, so use one instance per thread. The output of every stage is kept, so
+// after setParams() only the stages downstream of the changed values run again.
+class ColoringPageEngine {
+public:
+    enum class Stage {
+        Resize,
+        Grayscale,
+        Threshold,
+        Dilate,
+        Erode,
+        FindContours,
+        AnalyzeContours,
+        PostProcessContours,
+        ContourMask,
+        Compose,
+        Inpaint,
+    };
+
+    static constexpr int stageCount = static_cast<int>(Stage::Inpaint) + 1;
+
+    static const char* stageName(Stage stage) {
+        switch (stage) {
+        case Stage::Resize: return "Resize";
+        case Stage::Grayscale: return "Grayscale";
+        case Stage::Threshold: return "Threshold";
+        case Stage::Dilate: return "Dilate";
+        case Stage::Erode: return "Erode";
+        case Stage::FindContours: return "Find contours";
+        case Stage::AnalyzeContours: return "Analyze contours";
+        case Stage::PostProcessContours: return "Post-process contours";
+        case Stage::ContourMask: return "Contour mask";
+        case Stage::Compose: return "Compose";
+        case Stage::Inpaint: return "Inpaint gaps";
+        }
+        return "";
+    }
+
+    // Wall time of each stage in the last run. Stages before firstStage came from the cache
+    // and report 0.
+    struct Profile {
+        int firstStage = 0;
+        std::array<double, stageCount> stageMilliseconds{};
+        // "CPU", or "OpenCL: <device>" when the stages up to Erode ran on the device.
+        std::string backend = "CPU";
+        // The line extractor the Threshold stage ran.
+        std::string edgeDetector;
+
+        double totalMilliseconds() const {
+            double total = 0.0;
+            for (double milliseconds : stageMilliseconds) {
+                total += milliseconds;
+            }
+            return total;
+        }
+    };
+
+    // First stage whose output differs between the two parameter sets; stageCount if none.
+    static int firstAffectedStage(const PipelineParams& a, const PipelineParams& b) {
+        // The device path keeps its images on the device only, so a change of backend starts
+        // over from the source.
+        if (wantsOpenCL(a) != wantsOpenCL(b)) {
+            return static_cast<int>(Stage::Resize);
+        }
+        if (a.edgeMethod != b.edgeMethod || a.fusedThreshold != b.fusedThreshold || a.tileSize != b.tileSize) {
+            return static_cast<int>(Stage::Grayscale);
+        }
+        // Tiled, the Threshold stage produces the closed mask as well.
+        if (a.tileSize > 0 && a.closingKernelSize != b.closingKernelSize) {
+            return static_cast<int>(Stage::Threshold);
+        }
+        if (a.thresholdBlockSize != b.thresholdBlockSize || a.thresholdC != b.thresholdC || edgeSettingsDiffer(a, b)) {
+            return static_cast<int>(Stage::Threshold);
+        }
+        if (a.closingKernelSize != b.closingKernelSize) {
+            return static_cast<int>(Stage::Dilate);
+        }
+        if (a.minContourArea != b.minContourArea || a.contourEpsilon != b.contourEpsilon
+            || a.contourThickness != b.contourThickness || a.maskClosingSize != b.maskClosingSize) {
+            return static_cast<int>(Stage::PostProcessContours);
+        }
+        if (a.gapAreaThreshold != b.gapAreaThreshold || a.inpaintRadius != b.inpaintRadius) {
+            return static_cast<int>(Stage::Inpaint);
+        }
+        return stageCount;
+    }
+
+    static cv::Size fitSize(const cv::Size& source, const cv::Size& bounds) {
+        if (bounds.width <= 0 || bounds.height <= 0) {
+            return source;
+        }
+
+        double aspectRatio = static_cast<double>(source.width) / source.height;
+        int newWidth = bounds.width;
+        int newHeight = static_cast<int>(newWidth / aspectRatio);
+
+        if (newHeight > bounds.height) {
+            newHeight = bounds.height;
+            newWidth = static_cast<int>(newHeight * aspectRatio);
+        }
+
+        return cv::Size(newWidth, newHeight);
+    }
+
+    // Like fitSize, but a source that already fits keeps its size.
+    static cv::Size shrinkToFit(const cv::Size& source, const cv::Size& bounds) {
+        if (source.width <= bounds.width && source.height <= bounds.height) {
+            return source;
+        }
+        return fitSize(source, bounds);
+    }
+
+    // Called before every stage; returning false cancels the run.
+    using StageCallback = std::function<bool(Stage)>;
+
+    ColoringPageEngine() {
+        updateKernels();
+        updateEdgeDetector();
+    }
+
+    const PipelineParams& params() const {
+        return parameters;
+    }
+
+    const Profile& lastProfile() const {
+        return profile;
+    }
+
+    // The closed line mask of the last run, and the contour raster PostProcessContours drew
+    // over it; ContourMask masks the raster in place. For the benchmark's equivalence checks.
+    const cv::Mat& closedMask() const {
+        return erodedImage;
+    }
+
+    const cv::Mat& contourRaster() const {
+        return contourCanvas;
+    }
+
+    void setParams(const PipelineParams& params) {
+        validStages = std::min(validStages, firstAffectedStage(parameters, params));
+        bool kernelChanged = params.closingKernelSize != parameters.closingKernelSize;
+        bool detectorChanged = params.edgeMethod != parameters.edgeMethod || params.fusedThreshold != parameters.fusedThreshold
+            || params.thresholdBlockSize != parameters.thresholdBlockSize || params.thresholdC != parameters.thresholdC
+            || edgeSettingsDiffer(params, parameters) || params.lineArtBatch != parameters.lineArtBatch;
+        parameters = params;
+        if (kernelChanged) {
+            updateKernels();
+        }
+        if (detectorChanged) {
+            updateEdgeDetector();
+        }
+    }
+
+    // Returns a CV_8UC3 page of pageSize (source size when empty), or an empty Mat when
+    // onStage canceled the run. The page is the caller's to modify. Throws cv::Exception.
+    cv::Mat generateColoringPage(const cv::Mat& source, const cv::Size& pageSize = cv::Size(), const StageCallback& onStage = StageCallback()) {
+        sourceImage = source;
+        targetSize = pageSize;
+        validStages = 0;
+        if (source.empty()) {
+            return cv::Mat();
+        }
+        return runStages(onStage);
+    }
+
+    // Rebuilds the page of the last source with the current params, reusing every cached
+    // stage that they do not affect. A canceled run resumes where it stopped.
+    cv::Mat regenerate(const StageCallback& onStage = StageCallback()) {
+        if (sourceImage.empty()) {
+            return cv::Mat();
+        }
+        return runStages(onStage);
+    }
+
+    // Reduced pipeline for live video: only the stages the page is composed from (resize,
+    // grayscale, threshold, compose), without contour analysis and gap inpainting, and always
+    // on the CPU. The returned page is the engine's own buffer, valid until the next call.
+    // Leaves no stage cached for regenerate(). Throws cv::Exception.
+    const cv::Mat& generatePreview(const cv::Mat& source, const cv::Size& pageSize) {
+        sourceImage = source;
+        targetSize = pageSize;
+        validStages = 0;
+        onDevice = false;
+        for (Stage stage : { Stage::Resize, Stage::Grayscale, Stage::Threshold, Stage::Compose }) {
+            runStage(stage);
+        }
+        return composedPage;
+    }
+
+private:
+    cv::Mat runStages(const StageCallback& onStage) {
+        // The final stage writes the page handed out to the caller, so it always runs.
+        validStages = std::min(validStages, static_cast<int>(Stage::Inpaint));
+
+        onDevice = openCLSelected();
+
+        profile = Profile();
+        profile.firstStage = validStages;
+        profile.edgeDetector = edgeDetector->name();
+        if (tiled()) {
+            profile.edgeDetector += ", tiled";
+        }
+        if (onDevice) {
+            profile.backend = "OpenCL: " + cv::ocl::Device::getDefault().name();
+        }
+        for (int index = validStages; index < stageCount; ++index) {
+            Stage stage = static_cast<Stage>(index);
+            if (onStage && !onStage(stage)) {
+                return cv::Mat();
+            }
+            try {
+                ScopedTimer timer(profile.stageMilliseconds[index]);
+                runStage(stage);
+            }
+            catch (cv::Exception&) {
+                // A failing device stays disabled and the page is redone on the CPU; errors
+                // of the CPU path still reach the caller.
+                if (!onDevice || stage > Stage::Erode) {
+                    throw;
+                }
+                openCLFailed = true;
+                validStages = 0;
+                return runStages(onStage);
+            }
+            validStages = index + 1;
+        }
+        return coloringPage;
+    }
+
+    // Whether params ask for the device path; the device only runs the untiled adaptive
+    // threshold.
+    static bool wantsOpenCL(const PipelineParams& params) {
+        return params.useOpenCL && params.tileSize <= 0 && params.edgeMethod == EdgeMethod::AdaptiveThreshold;
+    }
+
+    bool openCLSelected() const {
+        return wantsOpenCL(parameters) && !openCLFailed && cv::ocl::haveOpenCL() && cv::ocl::useOpenCL();
+    }
+
+    // Tiling fuses the adaptive threshold with the closing, so it applies to that extractor
+    // only.
+    bool tiled() const {
+        return parameters.tileSize > 0 && parameters.edgeMethod == EdgeMethod::AdaptiveThreshold;
+    }
+
+    static bool edgeSettingsDiffer(const PipelineParams& a, const PipelineParams& b) {
+        return a.cannyLevels != b.cannyLevels || a.cannyLow != b.cannyLow || a.cannyHigh != b.cannyHigh
+            || a.xdogSigma != b.xdogSigma || a.xdogSharpness != b.xdogSharpness || a.xdogThreshold != b.xdogThreshold
+            || a.lineArtModel != b.lineArtModel;
+    }
+
+    void updateEdgeDetector() {
+        switch (parameters.edgeMethod) {
+        case EdgeMethod::AdaptiveThreshold:
+            edgeDetector = std::make_unique<AdaptiveThresholdDetector>(parameters.thresholdBlockSize, parameters.thresholdC, parameters.fusedThreshold);
+            break;
+        case EdgeMethod::PyramidCanny:
+            edgeDetector = std::make_unique<PyramidCannyDetector>(parameters.cannyLevels, parameters.cannyLow, parameters.cannyHigh);
+            break;
+        case EdgeMethod::XDoG:
+            edgeDetector = std::make_unique<XDoGDetector>(parameters.xdogSigma, parameters.xdogSharpness, parameters.xdogThreshold);
+            break;
+        case EdgeMethod::LineArtModel:
+            edgeDetector = std::make_unique<LineArtModelDetector>(parameters.lineArtModel, parameters.lineArtBatch);
+            break;
+        }
+    }
+
+    void runStage(Stage stage) {
+        if (onDevice && stage <= Stage::Erode) {
+            runStageOnDevice(stage);
+            return;
+        }
+
+        switch (stage) {
+        case Stage::Resize:
+            if (targetSize.area() > 0 && targetSize != sourceImage.size()) {
+                cv::resize(sourceImage, image, targetSize);
+            }
+            else {
+                image = sourceImage;
+            }
+            break;
+
+        // Extractors that read the color image directly, like the fused threshold, need no
+        // separate grayscale.
+        case Stage::Grayscale:
+            if (tiled() || !edgeDetector->usesGrayscale()) {
+                grayscale.release();
+            }
+            else {
+                cv::cvtColor(image, grayscale, cv::COLOR_BGR2GRAY);
+            }
+            break;
+
+        case Stage::Threshold:
+            if (tiled()) {
+                closeMaskTiled();
+                break;
+            }
+            edgeDetector->detect(image, grayscale, binaryImage);
+            break;
+
+        case Stage::Dilate:
+            if (!tiled()) {
+                morphology.dilate(binaryImage, dilatedImage, closingKernelSize());
+            }
+            break;
+
+        case Stage::Erode:
+            if (!tiled()) {
+                morphology.erode(dilatedImage, erodedImage, closingKernelSize());
+            }
+            break;
+
+        case Stage::FindContours:
+            // findContours resizes the vectors it is given, so the point storage of the last
+            // run is reused rather than freed.
+            cv::findContours(erodedImage, foundContours, contourHierarchy, cv::RETR_TREE, cv::CHAIN_APPROX_SIMPLE);
+            break;
+
+        case Stage::AnalyzeContours:
+            foundAreas.resize(foundContours.size());
+            parallelForContours(foundContours.size(), [this](int i) {
+                foundAreas[i] = cv::contourArea(foundContours[i]);
+            });
+            break;
+
+        case Stage::PostProcessContours:
+            erodedImage.copyTo(contourCanvas);
+            postProcessContours(parameters.minContourArea, parameters.contourEpsilon, parameters.contourThickness);
+            break;
+
+        case Stage::ContourMask: {
+            contourMask.create(contourCanvas.size(), CV_8U);
+            contourMask.setTo(cv::Scalar(0));
+            for (int i = 0; i < static_cast<int>(contours.size()); ++i) {
+                cv::drawContours(contourMask, contours, i, cv::Scalar(255), cv::FILLED);
+            }
+
+            closeMask(contourMask);
+            PixelKernels::applyMask<1>(contourCanvas, contourMask);
+            break;
+        }
+
+        case Stage::Compose:
+            PixelKernels::select<3>(binaryImage, composedPage, cv::Vec3b(0, 0, 0), cv::Vec3b(255, 255, 255));
+            break;
+
+        case Stage::Inpaint:
+            // Once the caller has dropped the previous page its buffer is ours again.
+            if (coloringPage.u && coloringPage.u->refcount == 1) {
+                composedPage.copyTo(coloringPage);
+            }
+            else {
+                coloringPage = composedPage.clone();
+            }
+            inpaintGaps(coloringPage, parameters.gapAreaThreshold, parameters.inpaintRadius);
+            break;
+        }
+    }
+
+    // Resize through Erode on the OpenCL device. The source is uploaded once, in Resize, and
+    // Erode brings the threshold and closed masks back as one two-channel download. Each
+    // stage waits for the device queue so the profile stays per stage.
+    void runStageOnDevice(Stage stage) {
+        switch (stage) {
+        case Stage::Resize:
+            image.release();
+            sourceImage.copyTo(deviceSource);
+            if (targetSize.area() > 0 && targetSize != sourceImage.size()) {
+                cv::resize(deviceSource, deviceImage, targetSize);
+            }
+            else {
+                deviceImage = deviceSource;
+            }
+            break;
+
+        case Stage::Grayscale:
+            cv::cvtColor(deviceImage, deviceGrayscale, cv::COLOR_BGR2GRAY);
+            break;
+
+        case Stage::Threshold:
+            cv::adaptiveThreshold(deviceGrayscale, deviceBinary, 255, cv::ADAPTIVE_THRESH_MEAN_C, cv::THRESH_BINARY_INV,
+                parameters.thresholdBlockSize, parameters.thresholdC);
+            break;
+
+        case Stage::Dilate:
+            cv::dilate(deviceBinary, deviceDilated, closingKernel);
+            break;
+
+        case Stage::Erode: {
+            cv::erode(deviceDilated, deviceEroded, closingKernel);
+            cv::merge(std::vector<cv::UMat>{ deviceBinary, deviceEroded }, deviceMasks);
+            deviceMasks.copyTo(hostMasks);
+
+            binaryImage.create(hostMasks.size(), CV_8U);
+            erodedImage.create(hostMasks.size(), CV_8U);
+            cv::Mat planes[] = { binaryImage, erodedImage };
+            cv::split(hostMasks, planes);
+            break;
+        }
+
+        default:
+            break;
+        }
+        cv::ocl::finish();
+    }
+
+    // Threshold, dilate and erode in tiles on cv::parallel_for_, writing binaryImage and
+    // erodedImage without page-sized grayscale or dilated temporaries. Each tile is read with
+    // a halo covering the threshold window and both closing passes, so its core is exactly
+    // the full-page result and tiles need no stitching; contours are then traced once on
+    // the assembled erodedImage.
+    void closeMaskTiled() {
+        const int tile = parameters.tileSize;
+        const int halo = parameters.thresholdBlockSize / 2 + parameters.closingKernelSize;
+        const int tilesX = (image.cols + tile - 1) / tile;
+        const int tilesY = (image.rows + tile - 1) / tile;
+        const cv::Rect pageRect(0, 0, image.cols, image.rows);
+        const cv::Size kernelSize = closingKernelSize();
+
+        grayscale.release();
+        dilatedImage.release();
+        binaryImage.create(image.size(), CV_8U);
+        erodedImage.create(image.size(), CV_8U);
+
+        cv::parallel_for_(cv::Range(0, tilesX * tilesY), [&](const cv::Range& range) {
+            RectMorphology tileMorphology;
+            cv::Mat tileGrayscale;
+            cv::Mat tileBinary;
+            cv::Mat tileDilated;
+            cv::Mat tileEroded;
+
+            for (int index = range.start; index < range.end; ++index) {
+                cv::Rect core = cv::Rect(index % tilesX * tile, index / tilesX * tile, tile, tile) & pageRect;
+                cv::Rect padded = cv::Rect(core.x - halo, core.y - halo, core.width + 2 * halo, core.height + 2 * halo) & pageRect;
+                cv::Rect coreInTile = core - padded.tl();
+
+                if (parameters.fusedThreshold) {
+                    FusedThreshold::apply(image(padded), tileBinary, parameters.thresholdBlockSize, parameters.thresholdC);
+                }
+                else {
+                    cv::cvtColor(image(padded), tileGrayscale, cv::COLOR_BGR2GRAY);
+                    cv::adaptiveThreshold(tileGrayscale, tileBinary, 255, cv::ADAPTIVE_THRESH_MEAN_C, cv::THRESH_BINARY_INV,
+                        parameters.thresholdBlockSize, parameters.thresholdC);
+                }
+                tileMorphology.dilate(tileBinary, tileDilated, kernelSize);
+                tileMorphology.erode(tileDilated, tileEroded, kernelSize);
+
+                tileBinary(coreInTile).copyTo(binaryImage(core));
+                tileEroded(coreInTile).copyTo(erodedImage(core));
+            }
+        });
+    }
+
+    cv::Size closingKernelSize() const {
+        return cv::Size(parameters.closingKernelSize, parameters.closingKernelSize);
+    }
+
+    // The structuring element of the OpenCL path is built once per parameter change, not per
+    // stage run.
+    void updateKernels() {
+        closingKernel = cv::getStructuringElement(cv::MORPH_RECT, closingKernelSize());
+    }
+
+    // Indices of the contours whose area reaches minContourArea, in contour order. A contour
+    // encloses its whole subtree in the RETR_TREE hierarchy, so every contour under one that
+    // is too small is too small as well and is skipped without being looked at.
+    void pruneContours(double minContourArea) {
+        const int count = static_cast<int>(foundContours.size());
+        keepContour.assign(count, 0);
+        contourStack.clear();
+        for (int i = 0; i < count; ++i) {
+            if (contourHierarchy[i][3] < 0) {
+                contourStack.push_back(i);
+            }
+        }
+
+        while (!contourStack.empty()) {
+            int parent = contourStack.back();
+            contourStack.pop_back();
+            if (foundAreas[parent] < minContourArea) {
+                continue;
+            }
+            keepContour[parent] = 1;
+            for (int child = contourHierarchy[parent][2]; child >= 0; child = contourHierarchy[child][0]) {
+                contourStack.push_back(child);
+            }
+        }
+
+        keptContours.clear();
+        for (int i = 0; i < count; ++i) {
+            if (keepContour[i]) {
+                keptContours.push_back(i);
+            }
+        }
+    }
+
+    // Calls body(i) for every i below count on cv::parallel_for_, in a few stripes per thread
+    // since a single contour is little work.
+    template <typename Body>
+    static void parallelForContours(size_t count, const Body& body) {
+        const int total = static_cast<int>(count);
+        cv::parallel_for_(cv::Range(0, total), [&body](const cv::Range& range) {
+            for (int i = range.start; i < range.end; ++i) {
+                body(i);
+            }
+        }, std::max(1, cv::getNumThreads()) * 4.0);
+    }
+
+    // MORPH_CLOSE with the mask closing rectangle, in place, through a kept scratch buffer.
+    void closeMask(cv::Mat& mask) {
+        const cv::Size kernelSize(parameters.maskClosingSize, parameters.maskClosingSize);
+        morphology.dilate(mask, closingScratch, kernelSize);
+        morphology.erode(closingScratch, mask, kernelSize);
+    }
+
+    // Inpaints every contour smaller than gapAreaThreshold inside its bounding box, padded so
+    // that Telea still sees all the known pixels it would weigh on the full page. Gaps are
+    // processed in contour order like before, so overlapping gaps build on each other.
+    void inpaintGaps(cv::Mat& page, double gapAreaThreshold, double inpaintRadius) {
+        const int padding = 2 * static_cast<int>(std::ceil(inpaintRadius)) + 2;
+        const cv::Rect pageRect(0, 0, page.cols, page.rows);
+
+        for (int i = 0; i < static_cast<int>(contours.size()); ++i) {
+            if (contourShapes[i].area >= gapAreaThreshold) {
+                continue;
+            }
+
+            const cv::Rect& bounds = contourShapes[i].bounds;
+            cv::Rect roi = cv::Rect(bounds.x - padding, bounds.y - padding, bounds.width + 2 * padding, bounds.height + 2 * padding) & pageRect;
+            if (roi.empty()) {
+                continue;
+            }
+
+            gapMask.create(roi.size(), CV_8U);
+            gapMask.setTo(cv::Scalar(0));
+            cv::drawContours(gapMask, contours, i, cv::Scalar(255), cv::FILLED,
+                cv::LINE_8, cv::noArray(), INT_MAX, -roi.tl());
+
+            cv::Mat pageRoi = page(roi);
+            cv::inpaint(pageRoi, gapMask, pageRoi, inpaintRadius, cv::INPAINT_TELEA);
+        }
+    }
+
+    // Simplifies the surviving contours and rasterizes them in one draw with a single closing
+    // pass. Only the simplified contours reach the final page: the 3-channel page is rebuilt
+    // from binaryImage afterwards.
+    void postProcessContours(double minContourArea, double smoothingIterations, int thickness)
+    {
+        pruneContours(minContourArea);
+
+        contours.resize(keptContours.size());
+        contourShapes.resize(keptContours.size());
+        parallelForContours(keptContours.size(), [this, smoothingIterations](int i) {
+            cv::approxPolyDP(foundContours[keptContours[i]], contours[i], smoothingIterations, true);
+            contourShapes[i] = ContourShape{ cv::contourArea(contours[i]), cv::boundingRect(contours[i]) };
+        });
+
+        if (contours.empty()) {
+            return;
+        }
+
+        cv::drawContours(contourCanvas, contours, -1, cv::Scalar(0, 0, 0), thickness, cv::LINE_AA);
+
+        closeMask(contourCanvas);
+    }
+
+    struct ContourShape {
+        double area;
+        cv::Rect bounds;
+    };
+
+    PipelineParams parameters;
+    int validStages = 0;
+    Profile profile;
+    std::unique_ptr<EdgeDetector> edgeDetector;
+    RectMorphology morphology;
+    bool onDevice = false;
+    bool openCLFailed = false;
+    cv::Mat closingKernel;
+
+    cv::Mat sourceImage;
+    cv::Size targetSize;
+    cv::Mat image;
+    cv::Mat grayscale;
+    cv::Mat binaryImage;
+    cv::Mat dilatedImage;
+    cv::Mat erodedImage;
+    std::vector<std::vector<cv::Point>> foundContours;
+    std::vector<cv::Vec4i> contourHierarchy;
+    std::vector<double> foundAreas;
+    std::vector<char> keepContour;
+    std::vector<int> contourStack;
+    std::vector<int> keptContours;
+    // The simplified survivors, with their measurements for the gap pass.
+    std::vector<std::vector<cv::Point>> contours;
+    std::vector<ContourShape> contourShapes;
+    cv::Mat contourCanvas;
+    cv::Mat contourMask;
+    cv::Mat composedPage;
+    cv::Mat gapMask;
+    cv::Mat closingScratch;
+    cv::Mat coloringPage;
+
+    cv::UMat deviceSource;
+    cv::UMat deviceImage;
+    cv::UMat deviceGrayscale;
+    cv::UMat deviceBinary;
+    cv::UMat deviceDilated;
+    cv::UMat deviceEroded;
+    cv::UMat deviceMasks;
+    cv::Mat hostMasks;
+};
@@ -0,0 +1,286 @@
+#pragma once
+
+#include <QImage>
+#include <QMouseEvent>
+#include <QPaintEvent>
+#include <QPainter>
+#include <QRegion>
+#include <QWheelEvent>
+#include <QWidget>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Shows the page at any zoom through a mip pyramid of half-size copies, so a paint only
+// touches about as many pixels as the widget has, whatever the page resolution. Edits to the
+// page image are pushed with refresh(), which updates the touched rectangle on every level.
+//
+// The wheel zooms around the cursor and the middle button pans. Button-less mouse moves are
+// reported through hoverMoved, in page coordinates, so a region under the cursor can be
+// highlighted; other mouse events propagate to the parent, which maps them with mapToImage.
+class DrawingCanvas : public QWidget {
+    Q_OBJECT
+
+public:
+    DrawingCanvas(QWidget* parent = nullptr) : QWidget(parent) {
+        setAttribute(Qt::WA_OpaquePaintEvent);
+        setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
+        setMouseTracking(true);
+    }
+
+    // The image must stay alive until the next setImage call. Fits the new page to the widget.
+    void setImage(const QImage* image) {
+        sourceImage = image;
+        buildPyramid();
+        fitToWindow();
+    }
+
+    // The zoom levels the canvas holds besides the page, and their pixel bytes.
+    int levelCount() const {
+        return static_cast<int>(levels.size());
+    }
+
+    qint64 levelBytes() const {
+        qint64 bytes = 0;
+        for (const QImage& level : levels) {
+            bytes += level.sizeInBytes();
+        }
+        return bytes;
+    }
+
+    void refresh(const QRect& dirtyRect) {
+        if (!sourceImage) {
+            return;
+        }
+
+        QRect rect = dirtyRect & sourceImage->rect();
+        if (rect.isEmpty()) {
+            return;
+        }
+
+        // Pixel x of a level averages pixels 2x and 2x + 1 of the level above it.
+        const QImage* previous = sourceImage;
+        QRect levelRect = rect;
+        for (QImage& level : levels) {
+            levelRect = QRect(QPoint(levelRect.left() / 2, levelRect.top() / 2), QPoint(levelRect.right() / 2, levelRect.bottom() / 2));
+            downsample(*previous, level, levelRect);
+            previous = &level;
+        }
+
+        update(widgetRect(rect));
+    }
+
+    // Tints the given area of the page, in page coordinates, on top of the image.
+    void setHighlight(const QRegion& region) {
+        QRect dirtyRect = highlight.boundingRect() | region.boundingRect();
+        highlight = region;
+        if (!dirtyRect.isEmpty()) {
+            update(widgetRect(dirtyRect));
+        }
+    }
+
+    // Page pixel under a widget position; may lie outside the page.
+    QPoint mapToImage(const QPoint& widgetPoint) const {
+        return QPoint(static_cast<int>(std::floor(widgetPoint.x() / zoom + origin.x())),
+            static_cast<int>(std::floor(widgetPoint.y() / zoom + origin.y())));
+    }
+
+    // The same point with its fraction kept, for strokes that follow the pen between pixels.
+    QPointF mapToImage(const QPointF& widgetPoint) const {
+        return widgetPoint / zoom + origin;
+    }
+
+    double zoomFactor() const {
+        return zoom;
+    }
+
+    // Shows the whole page centered; stays fitted across resizes until the user zooms.
+    void fitToWindow() {
+        fitted = true;
+        if (!sourceImage || sourceImage->isNull() || width() <= 0 || height() <= 0) {
+            update();
+            return;
+        }
+        double newZoom = std::min(static_cast<double>(width()) / sourceImage->width(), static_cast<double>(height()) / sourceImage->height());
+        setView(newZoom, QPointF((sourceImage->width() - width() / newZoom) / 2.0, (sourceImage->height() - height() / newZoom) / 2.0));
+    }
+
+    // Multiplies the zoom, keeping the page point under anchor in place.
+    void zoomAt(double factor, const QPoint& anchor) {
+        if (!sourceImage) {
+            return;
+        }
+        fitted = false;
+        QPointF anchorInImage = QPointF(anchor) / zoom + origin;
+        double newZoom = std::clamp(zoom * factor, 1.0 / 64.0, 32.0);
+        setView(newZoom, anchorInImage - QPointF(anchor) / newZoom);
+    }
+
+signals:
+    void hoverMoved(const QPoint& point);
+    void hoverLeft();
+    void zoomChanged(double zoom);
+
+protected:
+    void wheelEvent(QWheelEvent* event) override {
+        zoomAt(std::pow(1.25, event->angleDelta().y() / 120.0), event->position().toPoint());
+        event->accept();
+    }
+
+    void mousePressEvent(QMouseEvent* event) override {
+        if (event->button() == Qt::MiddleButton) {
+            panning = true;
+            lastPanPoint = event->position().toPoint();
+            setCursor(Qt::ClosedHandCursor);
+            event->accept();
+            return;
+        }
+        event->ignore();
+    }
+
+    void mouseMoveEvent(QMouseEvent* event) override {
+        if (panning) {
+            fitted = false;
+            origin -= QPointF(event->position().toPoint() - lastPanPoint) / zoom;
+            lastPanPoint = event->position().toPoint();
+            update();
+            event->accept();
+            return;
+        }
+        if (event->buttons() == Qt::NoButton) {
+            emit hoverMoved(mapToImage(event->position().toPoint()));
+        }
+        event->ignore();
+    }
+
+    void mouseReleaseEvent(QMouseEvent* event) override {
+        if (event->button() == Qt::MiddleButton && panning) {
+            panning = false;
+            unsetCursor();
+            event->accept();
+            return;
+        }
+        event->ignore();
+    }
+
+    void leaveEvent(QEvent* event) override {
+        emit hoverLeft();
+        QWidget::leaveEvent(event);
+    }
+
+    void resizeEvent(QResizeEvent* event) override {
+        QWidget::resizeEvent(event);
+        if (fitted) {
+            fitToWindow();
+        }
+    }
+
+    void paintEvent(QPaintEvent* event) override {
+        QPainter painter(this);
+        painter.fillRect(event->rect(), Qt::white);
+        if (!sourceImage || sourceImage->isNull()) {
+            return;
+        }
+
+        // From here on the painter works in page coordinates.
+        painter.scale(zoom, zoom);
+        painter.translate(-origin);
+        QRectF visible = painter.transform().inverted().mapRect(QRectF(event->rect())) & QRectF(sourceImage->rect());
+        if (visible.isEmpty()) {
+            return;
+        }
+        painter.setClipRect(visible);
+
+        // The smallest level that still has at least one pixel per screen pixel.
+        int level = 0;
+        while (level < static_cast<int>(levels.size()) && zoom * (1 << (level + 1)) <= 1.0) {
+            ++level;
+        }
+        const QImage& image = level == 0 ? *sourceImage : levels[level - 1];
+        const int scale = 1 << level;
+
+        QRect levelRect = QRectF(visible.x() / scale, visible.y() / scale, visible.width() / scale, visible.height() / scale).toAlignedRect() & image.rect();
+        painter.save();
+        painter.scale(scale, scale);
+        painter.setRenderHint(QPainter::SmoothPixmapTransform, zoom * scale < 1.0);
+        painter.drawImage(levelRect.topLeft(), image, levelRect);
+        painter.restore();
+
+        QRegion highlighted = highlight.intersected(visible.toAlignedRect());
+        if (!highlighted.isEmpty()) {
+            painter.setClipRegion(highlighted, Qt::IntersectClip);
+            painter.fillRect(highlighted.boundingRect(), QColor(0, 120, 215, 64));
+        }
+    }
+
+private:
+    static constexpr int minLevelSize = 256;
+
+    void buildPyramid() {
+        levels.clear();
+        if (!sourceImage || sourceImage->isNull()) {
+            return;
+        }
+
+        while (true) {
+            const QImage& previous = levels.empty() ? *sourceImage : levels.back();
+            if (previous.width() <= minLevelSize && previous.height() <= minLevelSize) {
+                break;
+            }
+            QImage level((previous.width() + 1) / 2, (previous.height() + 1) / 2, previous.format());
+            downsample(previous, level, level.rect());
+            levels.push_back(std::move(level));
+        }
+    }
+
+    // 2x2 box average of source into rect of target; the last row and column of an odd-sized
+    // source are repeated.
+    static void downsample(const QImage& source, QImage& target, const QRect& rect) {
+        const int bytesPerPixel = source.depth() / 8;
+        const int lastX = source.width() - 1;
+        const int lastY = source.height() - 1;
+
+        for (int y = rect.top(); y <= rect.bottom(); ++y) {
+            const uchar* row0 = source.constScanLine(2 * y);
+            const uchar* row1 = source.constScanLine(std::min(2 * y + 1, lastY));
+            uchar* out = target.scanLine(y);
+            for (int x = rect.left(); x <= rect.right(); ++x) {
+                const int x0 = 2 * x * bytesPerPixel;
+                const int x1 = std::min(2 * x + 1, lastX) * bytesPerPixel;
+                for (int channel = 0; channel < bytesPerPixel; ++channel) {
+                    out[x * bytesPerPixel + channel] = static_cast<uchar>(
+                        (row0[x0 + channel] + row0[x1 + channel] + row1[x0 + channel] + row1[x1 + channel] + 2) >> 2);
+                }
+            }
+        }
+    }
+
+    void setView(double newZoom, const QPointF& newOrigin) {
+        bool zoomed = newZoom != zoom;
+        zoom = newZoom;
+        origin = newOrigin;
+        update();
+        if (zoomed) {
+            emit zoomChanged(zoom);
+        }
+    }
+
+    // Widget area covering a rectangle of page pixels.
+    QRect widgetRect(const QRect& imageRect) const {
+        return QRectF((imageRect.x() - origin.x()) * zoom, (imageRect.y() - origin.y()) * zoom,
+            imageRect.width() * zoom, imageRect.height() * zoom).toAlignedRect().adjusted(-1, -1, 1, 1);
+    }
+
+    const QImage* sourceImage = nullptr;
+    // levels[i] is half the size of levels[i - 1]; the page itself is level 0.
+    std::vector<QImage> levels;
+    QRegion highlight;
+
+    // Widget position p shows page position p / zoom + origin.
+    double zoom = 1.0;
+    QPointF origin;
+    bool fitted = true;
+    bool panning = false;
+    QPoint lastPanPoint;
+};
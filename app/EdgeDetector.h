@@ -0,0 +1,220 @@
+#pragma once
+
+#include "FusedThreshold.h"
+
+#include <opencv2/dnn.hpp>
+#include <opencv2/opencv.hpp>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// Line extractors for the engine's Threshold stage. Every detector turns the resized page
+// into a CV_8U mask with 255 on lines; closing, contour analysis and inpainting then treat
+// all of them alike. Detectors keep their scratch buffers, so like the engine that owns one
+// they serve one thread.
+enum class EdgeMethod {
+    AdaptiveThreshold,
+    PyramidCanny,
+    XDoG,
+    LineArtModel,
+};
+
+// Parses the command-line names: adaptive, canny, xdog and model.
+inline bool edgeMethodFromName(const std::string& name, EdgeMethod* method) {
+    static const struct {
+        const char* name;
+        EdgeMethod method;
+    } methods[] = {
+        { "adaptive", EdgeMethod::AdaptiveThreshold },
+        { "canny", EdgeMethod::PyramidCanny },
+        { "xdog", EdgeMethod::XDoG },
+        { "model", EdgeMethod::LineArtModel },
+    };
+    for (const auto& entry : methods) {
+        if (name == entry.name) {
+            *method = entry.method;
+            return true;
+        }
+    }
+    return false;
+}
+
+class EdgeDetector {
+public:
+    virtual ~EdgeDetector() = default;
+
+    // Shown in profiles, next to the cost of the Threshold stage.
+    virtual const char* name() const = 0;
+
+    // Whether detect() reads grayscale. When false the engine skips the Grayscale stage and
+    // passes an empty Mat.
+    virtual bool usesGrayscale() const {
+        return true;
+    }
+
+    // image is CV_8UC3. Throws cv::Exception.
+    virtual void detect(const cv::Mat& image, const cv::Mat& grayscale, cv::Mat& lines) = 0;
+};
+
+// The original extractor: ADAPTIVE_THRESH_MEAN_C, through FusedThreshold when fused.
+class AdaptiveThresholdDetector : public EdgeDetector {
+public:
+    AdaptiveThresholdDetector(int blockSize, double c, bool fused) : blockSize(blockSize), c(c), fused(fused) {
+    }
+
+    const char* name() const override {
+        return fused ? "Adaptive threshold (fused)" : "Adaptive threshold";
+    }
+
+    bool usesGrayscale() const override {
+        return !fused;
+    }
+
+    void detect(const cv::Mat& image, const cv::Mat& grayscale, cv::Mat& lines) override {
+        if (fused) {
+            FusedThreshold::apply(image, lines, blockSize, c);
+            return;
+        }
+        cv::adaptiveThreshold(grayscale, lines, 255, cv::ADAPTIVE_THRESH_MEAN_C, cv::THRESH_BINARY_INV, blockSize, c);
+    }
+
+private:
+    int blockSize;
+    double c;
+    bool fused;
+};
+
+// Canny on the grayscale reduced levels times with pyrDown, scaled back up. Every level cuts
+// the Canny cost by four and doubles the width of the lines, which the closing and contour
+// stages want wide anyway; pyrDown's smoothing stands in for Canny's usual blur.
+class PyramidCannyDetector : public EdgeDetector {
+public:
+    PyramidCannyDetector(int levels, double lowThreshold, double highThreshold)
+        : levels(std::max(0, levels)), lowThreshold(lowThreshold), highThreshold(highThreshold) {
+    }
+
+    const char* name() const override {
+        return "Pyramid Canny";
+    }
+
+    void detect(const cv::Mat&, const cv::Mat& grayscale, cv::Mat& lines) override {
+        if (levels == 0) {
+            pyramid.resize(1);
+            cv::GaussianBlur(grayscale, pyramid[0], cv::Size(5, 5), 0);
+            cv::Canny(pyramid[0], lines, lowThreshold, highThreshold, 3, true);
+            return;
+        }
+
+        pyramid.resize(levels);
+        const cv::Mat* level = &grayscale;
+        for (cv::Mat& reduced : pyramid) {
+            cv::pyrDown(*level, reduced);
+            level = &reduced;
+        }
+        cv::Canny(*level, edges, lowThreshold, highThreshold, 3, true);
+
+        // Bilinear upscaling spreads every edge pixel over the area it stands for.
+        cv::resize(edges, lines, grayscale.size(), 0, 0, cv::INTER_LINEAR);
+        cv::threshold(lines, lines, 0, 255, cv::THRESH_BINARY);
+    }
+
+private:
+    int levels;
+    double lowThreshold;
+    double highThreshold;
+    std::vector<cv::Mat> pyramid;
+    cv::Mat edges;
+};
+
+// Extended difference of Gaussians (Winnemoeller et al.) with a hard threshold: the narrow
+// blur sharpened against a 1.6 times wider one, lines where the result falls below
+// threshold. Two separable blurs per page, independent of the line width.
+class XDoGDetector : public EdgeDetector {
+public:
+    XDoGDetector(double sigma, double sharpness, double threshold) : sigma(sigma), sharpness(sharpness), threshold(threshold) {
+    }
+
+    const char* name() const override {
+        return "XDoG";
+    }
+
+    void detect(const cv::Mat&, const cv::Mat& grayscale, cv::Mat& lines) override {
+        grayscale.convertTo(luma, CV_32F, 1.0 / 255.0);
+        cv::GaussianBlur(luma, narrow, cv::Size(), sigma);
+        cv::GaussianBlur(luma, wide, cv::Size(), 1.6 * sigma);
+        cv::addWeighted(narrow, 1.0 + sharpness, wide, -sharpness, 0.0, narrow);
+        cv::compare(narrow, threshold, lines, cv::CMP_LT);
+    }
+
+private:
+    double sigma;
+    double sharpness;
+    double threshold;
+    cv::Mat luma;
+    cv::Mat narrow;
+    cv::Mat wide;
+};
+
+// A line-art network run through cv::dnn on overlapping tiles, batch tiles per forward pass.
+// The model takes NCHW RGB in [0, 1] at any tile size and returns, at the same size, one
+// channel with the probability of a line; pixels above one half become lines. Tiles overlap
+// by a halo that is cut away again, so the network never sees a page edge inside the page.
+// The model is loaded on first use and kept.
+class LineArtModelDetector : public EdgeDetector {
+public:
+    static constexpr int tileSize = 512;
+    static constexpr int halo = 32;
+
+    LineArtModelDetector(const std::string& modelPath, int batch) : modelPath(modelPath), batch(std::max(1, batch)) {
+    }
+
+    const char* name() const override {
+        return "Line-art model";
+    }
+
+    bool usesGrayscale() const override {
+        return false;
+    }
+
+    void detect(const cv::Mat& image, const cv::Mat&, cv::Mat& lines) override {
+        if (net.empty()) {
+            net = cv::dnn::readNet(modelPath);
+        }
+
+        const int core = tileSize - 2 * halo;
+        const int tilesX = (image.cols + core - 1) / core;
+        const int tilesY = (image.rows + core - 1) / core;
+        cv::copyMakeBorder(image, padded, halo, tilesY * core - image.rows + halo, halo, tilesX * core - image.cols + halo, cv::BORDER_REFLECT_101);
+        lines.create(image.size(), CV_8U);
+
+        const int tileCount = tilesX * tilesY;
+        for (int first = 0; first < tileCount; first += batch) {
+            const int last = std::min(first + batch, tileCount);
+            windows.clear();
+            for (int index = first; index < last; ++index) {
+                windows.push_back(padded(cv::Rect(index % tilesX * core, index / tilesX * core, tileSize, tileSize)));
+            }
+
+            cv::dnn::blobFromImages(windows, blob, 1.0 / 255.0, cv::Size(), cv::Scalar(), true, false);
+            net.setInput(blob);
+            cv::Mat output = net.forward();
+            CV_Assert(output.dims == 4 && output.size[0] == last - first && output.size[2] == tileSize && output.size[3] == tileSize);
+
+            for (int index = first; index < last; ++index) {
+                cv::Mat probability(tileSize, tileSize, CV_32F, output.ptr<float>(index - first, 0));
+                cv::Rect target = cv::Rect(index % tilesX * core, index / tilesX * core, core, core) & cv::Rect(0, 0, image.cols, image.rows);
+                cv::Mat tileLines = lines(target);
+                cv::compare(probability(cv::Rect(halo, halo, target.width, target.height)), 0.5, tileLines, cv::CMP_GT);
+            }
+        }
+    }
+
+private:
+    std::string modelPath;
+    int batch;
+    cv::dnn::Net net;
+    cv::Mat padded;
+    std::vector<cv::Mat> windows;
+    cv::Mat blob;
+};
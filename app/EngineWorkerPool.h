@@ -0,0 +1,106 @@
+#pragma once
+
+#include "ColoringPageEngine.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads, each with its own ColoringPageEngine, pulling jobs from a shared queue.
+// Jobs must handle their own errors; an exception escaping a job terminates the process.
+class EngineWorkerPool {
+public:
+    using Job = std::function<void(ColoringPageEngine&)>;
+
+    explicit EngineWorkerPool(int workerCount) {
+        if (workerCount < 1) {
+            workerCount = 1;
+        }
+        for (int i = 0; i < workerCount; ++i) {
+            workers.emplace_back(&EngineWorkerPool::workerLoop, this);
+        }
+    }
+
+    ~EngineWorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        jobAvailable.notify_all();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    }
+
+    EngineWorkerPool(const EngineWorkerPool&) = delete;
+    EngineWorkerPool& operator=(const EngineWorkerPool&) = delete;
+
+    void submit(Job job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+        jobAvailable.notify_one();
+    }
+
+    void waitForDone() {
+        std::unique_lock<std::mutex> lock(mutex);
+        jobsDone.wait(lock, [this] { return jobs.empty() && activeJobs == 0; });
+    }
+
+    int workerCount() const {
+        return static_cast<int>(workers.size());
+    }
+
+    // Jobs submitted but not started yet.
+    int queuedJobs() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return static_cast<int>(jobs.size());
+    }
+
+    // Jobs currently running.
+    int busyWorkers() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return activeJobs;
+    }
+
+private:
+    void workerLoop() {
+        ColoringPageEngine engine;
+
+        for (;;) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                jobAvailable.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (jobs.empty()) {
+                    return;
+                }
+                job = std::move(jobs.front());
+                jobs.pop_front();
+                ++activeJobs;
+            }
+
+            job(engine);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                --activeJobs;
+                if (jobs.empty() && activeJobs == 0) {
+                    jobsDone.notify_all();
+                }
+            }
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::deque<Job> jobs;
+    mutable std::mutex mutex;
+    std::condition_variable jobAvailable;
+    std::condition_variable jobsDone;
+    int activeJobs = 0;
+    bool stopping = false;
+};
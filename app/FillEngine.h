@@ -0,0 +1,59 @@
+#pragma once
+
+#include "PixelKernels.h"
+
+#include <opencv2/opencv.hpp>
+
+// Bucket fill for the page. The floodFill mask is kept between fills and only the filled
+// rectangle of it is touched, so a fill costs O(region) instead of O(page).
+class FillEngine {
+public:
+    // Pixels set in walls, a CV_8U mask of the page's size, stop later fills as lines do.
+    // The walls live in the floodFill mask, so switching them costs one pass over the page
+    // and setting the same walls again costs nothing. An empty Mat removes them.
+    void setWalls(const cv::Mat& newWalls) {
+        if (newWalls.data == walls.data && newWalls.size() == walls.size()) {
+            return;
+        }
+        walls = newWalls;
+        mask.release();
+    }
+
+    // Paints the 4-connected area sharing the seed pixel's color on a CV_8UC3 page and returns
+    // its bounding rectangle; the rectangle is empty when the seed lies outside the page.
+    cv::Rect fill(cv::Mat& page, const cv::Point& seed, const cv::Scalar& color) {
+        if (!cv::Rect(0, 0, page.cols, page.rows).contains(seed)) {
+            return cv::Rect();
+        }
+
+        if (mask.rows != page.rows + 2 || mask.cols != page.cols + 2) {
+            mask = cv::Mat::zeros(page.rows + 2, page.cols + 2, CV_8U);
+            if (walls.size() == page.size()) {
+                mask(cv::Rect(1, 1, page.cols, page.rows)).setTo(cv::Scalar(wallValue), walls);
+            }
+        }
+        if (mask.at<uchar>(seed + cv::Point(1, 1)) == wallValue) {
+            return cv::Rect();
+        }
+
+        cv::Rect filled;
+        const int flags = 4 | cv::FLOODFILL_MASK_ONLY | (filledValue << 8);
+        cv::floodFill(page, mask, seed, color, &filled, cv::Scalar(), cv::Scalar(), flags);
+        if (filled.empty()) {
+            return filled;
+        }
+
+        // The filled rectangle can hold walls too; only the pixels just filled are painted
+        // and cleared.
+        cv::Vec3b pixel(cv::saturate_cast<uchar>(color[0]), cv::saturate_cast<uchar>(color[1]), cv::saturate_cast<uchar>(color[2]));
+        PixelKernels::paintAndClear<3>(page(filled), mask(filled + cv::Point(1, 1)), filledValue, pixel);
+        return filled;
+    }
+
+private:
+    static constexpr uchar wallValue = 1;
+    static constexpr uchar filledValue = 255;
+
+    cv::Mat walls;
+    cv::Mat mask;
+};
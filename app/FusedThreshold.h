@@ -0,0 +1,122 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+
+#include <algorithm>
+#include <vector>
+
+// BGR -> luma -> ADAPTIVE_THRESH_MEAN_C / THRESH_BINARY_INV in a single pass, without the
+// full-frame grayscale Mat and box-filtered mean that cv::cvtColor + cv::adaptiveThreshold
+// write and read back. Rows are processed in tiles on cv::parallel_for_; each tile keeps
+// blockSize + 1 luma rows and one column-sum row, updated as the window slides down.
+//
+// The arithmetic follows OpenCV's: the 14-bit fixed-point BGR2GRAY weights, the rounded
+// 8-bit mean with replicated borders, and floor(C) as the offset. The output is meant to be
+// identical; the benchmark reports any pixel where the two paths disagree. The inner loops
+// are plain element-wise loops over contiguous rows, so the compiler vectorizes them for
+// whichever instruction set the build targets.
+class FusedThreshold {
+public:
+    static void apply(const cv::Mat& bgr, cv::Mat& binary, int blockSize, double c, uchar maxValue = 255) {
+        CV_Assert(bgr.type() == CV_8UC3 && blockSize % 2 == 1 && blockSize > 1);
+
+        binary.create(bgr.size(), CV_8U);
+        const int rows = bgr.rows;
+        const int tileRows = 128;
+        const int tiles = (rows + tileRows - 1) / tileRows;
+        const int offset = cvFloor(c);
+
+        cv::parallel_for_(cv::Range(0, tiles), [&](const cv::Range& range) {
+            Tile tile(bgr, blockSize);
+            for (int index = range.start; index < range.end; ++index) {
+                int firstRow = index * tileRows;
+                tile.run(binary, firstRow, std::min(rows, firstRow + tileRows), offset, maxValue);
+            }
+        });
+    }
+
+private:
+    class Tile {
+    public:
+        Tile(const cv::Mat& bgr, int blockSize)
+            : bgr(bgr), blockSize(blockSize), radius(blockSize / 2), ringRows(blockSize + 1),
+              luma(static_cast<size_t>(ringRows) * bgr.cols), columnSums(bgr.cols),
+              rowPrefix(bgr.cols + blockSize + 1), windowSums(bgr.cols) {
+        }
+
+        void run(cv::Mat& binary, int firstRow, int endRow, int offset, uchar maxValue) {
+            const int cols = bgr.cols;
+            const int area = blockSize * blockSize;
+            const int half = area / 2;
+
+            computedRow = clampRow(firstRow - radius) - 1;
+
+            std::fill(columnSums.begin(), columnSums.end(), 0);
+            for (int dy = -radius; dy <= radius; ++dy) {
+                const uchar* row = lumaRow(clampRow(firstRow + dy));
+                for (int x = 0; x < cols; ++x) {
+                    columnSums[x] += row[x];
+                }
+            }
+
+            for (int y = firstRow; y < endRow; ++y) {
+                if (y > firstRow) {
+                    const uchar* added = lumaRow(clampRow(y + radius));
+                    const uchar* removed = lumaRow(clampRow(y - 1 - radius));
+                    for (int x = 0; x < cols; ++x) {
+                        columnSums[x] += added[x] - removed[x];
+                    }
+                }
+
+                // Horizontal box sums with replicated borders, through a prefix over the
+                // padded row so the per-pixel work below has no loop-carried dependency.
+                rowPrefix[0] = 0;
+                for (int i = 0; i < cols + 2 * radius; ++i) {
+                    int x = std::min(std::max(i - radius, 0), cols - 1);
+                    rowPrefix[i + 1] = rowPrefix[i] + columnSums[x];
+                }
+                for (int x = 0; x < cols; ++x) {
+                    windowSums[x] = rowPrefix[x + blockSize] - rowPrefix[x];
+                }
+
+                // OpenCV sets the pixel when src - round(sum / area) <= -offset, which is
+                // sum + area / 2 >= (src + offset) * area without the division.
+                const uchar* source = lumaRow(y);
+                uchar* target = binary.ptr<uchar>(y);
+                for (int x = 0; x < cols; ++x) {
+                    target[x] = windowSums[x] + half >= (source[x] + offset) * area ? maxValue : 0;
+                }
+            }
+        }
+
+    private:
+        int clampRow(int y) const {
+            return std::min(std::max(y, 0), bgr.rows - 1);
+        }
+
+        // Rows are requested in non-decreasing order, and never more than blockSize rows
+        // behind the newest one, so a ring of blockSize + 1 rows is enough.
+        const uchar* lumaRow(int y) {
+            while (computedRow < y) {
+                ++computedRow;
+                const uchar* source = bgr.ptr<uchar>(computedRow);
+                uchar* target = &luma[static_cast<size_t>(computedRow % ringRows) * bgr.cols];
+                for (int x = 0; x < bgr.cols; ++x) {
+                    const uchar* pixel = source + 3 * x;
+                    target[x] = static_cast<uchar>((pixel[0] * 1868 + pixel[1] * 9617 + pixel[2] * 4899 + (1 << 13)) >> 14);
+                }
+            }
+            return &luma[static_cast<size_t>(y % ringRows) * bgr.cols];
+        }
+
+        const cv::Mat& bgr;
+        const int blockSize;
+        const int radius;
+        const int ringRows;
+        int computedRow = -1;
+        std::vector<uchar> luma;
+        std::vector<int> columnSums;
+        std::vector<int> rowPrefix;
+        std::vector<int> windowSums;
+    };
+};
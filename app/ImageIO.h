@@ -0,0 +1,98 @@
+#pragma once
+
+#include "ColoringPageEngine.h"
+
+#include <QBuffer>
+#include <QByteArray>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QString>
+
+#include <opencv2/opencv.hpp>
+
+#include <vector>
+
+// Image files through Qt's file layer and OpenCV's in-memory codecs, so paths are never
+// squeezed through a narrow std::string: non-ASCII names work on every platform.
+class ImageIO {
+public:
+    // Decodes path for a page that will be scaled down to fit bounds. When the page is at most
+    // a half, quarter or eighth of the source, the decoder reduces while decoding (DCT scaling
+    // for JPEG) and never holds the full-resolution image. Empty bounds decode at full size.
+    // Returns an empty Mat when the file cannot be read or decoded.
+    static cv::Mat load(const QString& path, const cv::Size& bounds = cv::Size(), int* reduction = nullptr) {
+        QByteArray bytes = read(path);
+        return decode(bytes, bounds, reduction);
+    }
+
+    // The raw file contents; empty when the file cannot be read.
+    static QByteArray read(const QString& path) {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            return QByteArray();
+        }
+        return file.readAll();
+    }
+
+    // load() for bytes already read.
+    static cv::Mat decode(QByteArray& bytes, const cv::Size& bounds = cv::Size(), int* reduction = nullptr) {
+        if (bytes.isEmpty()) {
+            return cv::Mat();
+        }
+
+        int factor = reductionFor(bytes, bounds);
+        if (reduction) {
+            *reduction = factor;
+        }
+        return cv::imdecode(cv::Mat(1, static_cast<int>(bytes.size()), CV_8U, bytes.data()), decodeFlags(factor));
+    }
+
+    // Encodes in the format of path's extension. Returns false on failure.
+    static bool save(const QString& path, const cv::Mat& image) {
+        std::vector<uchar> encoded;
+        QString extension = "." + QFileInfo(path).suffix().toLower();
+        if (!cv::imencode(extension.toStdString(), image, encoded)) {
+            return false;
+        }
+
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly)) {
+            return false;
+        }
+        return file.write(reinterpret_cast<const char*>(encoded.data()), static_cast<qint64>(encoded.size())) == static_cast<qint64>(encoded.size());
+    }
+
+private:
+    // Largest of 1, 2, 4 and 8 that still leaves at least the fitted page size. Only the
+    // header is parsed to learn the source size.
+    static int reductionFor(QByteArray& bytes, const cv::Size& bounds) {
+        if (bounds.width <= 0 || bounds.height <= 0) {
+            return 1;
+        }
+
+        QBuffer buffer(&bytes);
+        QImageReader reader(&buffer);
+        QSize size = reader.size();
+        if (!size.isValid()) {
+            return 1;
+        }
+
+        cv::Size source(size.width(), size.height());
+        cv::Size target = ColoringPageEngine::shrinkToFit(source, bounds);
+        int factor = 1;
+        while (factor < 8 && source.width / (2 * factor) >= target.width && source.height / (2 * factor) >= target.height) {
+            factor *= 2;
+        }
+        return factor;
+    }
+
+    static int decodeFlags(int factor) {
+        switch (factor) {
+        case 2: return cv::IMREAD_REDUCED_COLOR_2;
+        case 4: return cv::IMREAD_REDUCED_COLOR_4;
+        case 8: return cv::IMREAD_REDUCED_COLOR_8;
+        default: return cv::IMREAD_COLOR;
+        }
+    }
+};
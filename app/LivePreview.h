@@ -0,0 +1,243 @@
+#pragma once
+
+#include "ColoringPageEngine.h"
+#include "ScopedTimer.h"
+
+#include <QObject>
+#include <QString>
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/videoio.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Live coloring-page preview of a camera. One thread reads frames as fast as the camera
+// delivers them and keeps only the newest; a second converts the newest frame through the
+// engine's reduced preview pipeline, at most once per frame budget. Frames that arrive while
+// one is being converted replace each other and are dropped, never queued, so the preview
+// lags the camera by at most one frame.
+//
+// Converted pages go to a back buffer that is swapped with the front buffer the window
+// paints from, together with the camera frame they came from.
+class LivePreview : public QObject {
+    Q_OBJECT
+
+public:
+    explicit LivePreview(QObject* parent = nullptr) : QObject(parent) {
+    }
+
+    ~LivePreview() {
+        stop();
+    }
+
+    // Opens camera at about bounds on the capture thread and starts converting; returns at
+    // once. Camera backends can take seconds to open a device, so the outcome arrives later
+    // as opened() or failed().
+    void start(int camera, const cv::Size& bounds = cv::Size(1280, 720), double framesPerSecond = 30.0) {
+        stop();
+        previewBounds = bounds;
+        frameBudget = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / framesPerSecond));
+        stopping = false;
+        frameWaiting = false;
+        droppedFrames = 0;
+        captureThread = std::thread(&LivePreview::captureLoop, this, camera);
+        convertThread = std::thread(&LivePreview::convertLoop, this);
+    }
+
+    // Waits for an open in progress to finish.
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(frameMutex);
+            stopping = true;
+        }
+        frameArrived.notify_all();
+        if (captureThread.joinable()) {
+            captureThread.join();
+        }
+        if (convertThread.joinable()) {
+            convertThread.join();
+        }
+        capture.release();
+    }
+
+    bool isRunning() const {
+        return convertThread.joinable();
+    }
+
+    // Applies from the next converted frame on. Whatever extractor the page uses, the
+    // preview always runs the untiled fused adaptive threshold.
+    void setParams(const PipelineParams& params) {
+        std::lock_guard<std::mutex> lock(paramsMutex);
+        pendingParams = previewParams(params);
+        paramsChanged = true;
+    }
+
+    // The camera frame the front page was made from, at the camera's resolution; empty before
+    // the first page.
+    cv::Mat currentFrame() const {
+        std::lock_guard<std::mutex> lock(bufferMutex);
+        return frontFrame.clone();
+    }
+
+    // Calls draw(page) on the front page while holding the buffer lock; keep draw short.
+    template <typename Draw>
+    void withFrontPage(Draw draw) const {
+        std::lock_guard<std::mutex> lock(bufferMutex);
+        draw(frontPage);
+    }
+
+signals:
+    // The camera opened; pages follow.
+    void opened();
+    // A new page is in the front buffer. Not emitted again before this one is delivered, so
+    // a busy window skips pages instead of queuing them.
+    void pageReady();
+    // About once a second: pages converted per second, mean conversion time and camera
+    // frames dropped since the start.
+    void statsUpdated(double pagesPerSecond, double convertMilliseconds, int droppedFrames);
+    void failed(const QString& message);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    void captureLoop(int camera) {
+        bool isOpen = capture.open(camera);
+        if (stopping) {
+            return;
+        }
+        if (!isOpen) {
+            QMetaObject::invokeMethod(this, [this]() {
+                emit failed("No camera found.");
+            }, Qt::QueuedConnection);
+            return;
+        }
+        capture.set(cv::CAP_PROP_FRAME_WIDTH, previewBounds.width);
+        capture.set(cv::CAP_PROP_FRAME_HEIGHT, previewBounds.height);
+        QMetaObject::invokeMethod(this, [this]() {
+            emit opened();
+        }, Qt::QueuedConnection);
+
+        cv::Mat frame;
+        while (!stopping) {
+            if (!capture.read(frame) || frame.empty()) {
+                QMetaObject::invokeMethod(this, [this]() {
+                    emit failed("The camera stopped delivering frames.");
+                }, Qt::QueuedConnection);
+                break;
+            }
+            {
+                std::lock_guard<std::mutex> lock(frameMutex);
+                if (frameWaiting) {
+                    ++droppedFrames;
+                }
+                std::swap(newestFrame, frame);
+                frameWaiting = true;
+            }
+            frameArrived.notify_one();
+        }
+    }
+
+    void convertLoop() {
+        ColoringPageEngine engine;
+        cv::Mat frame;
+        cv::Mat backPage;
+        Clock::time_point nextStart = Clock::now();
+        Clock::time_point statsStart = nextStart;
+        int pages = 0;
+        double convertTotal = 0.0;
+
+        for (;;) {
+            std::this_thread::sleep_until(nextStart);
+            {
+                std::unique_lock<std::mutex> lock(frameMutex);
+                frameArrived.wait(lock, [this] { return stopping || frameWaiting; });
+                if (stopping) {
+                    return;
+                }
+                std::swap(frame, newestFrame);
+                frameWaiting = false;
+            }
+            nextStart = Clock::now() + frameBudget;
+
+            {
+                std::lock_guard<std::mutex> lock(paramsMutex);
+                if (paramsChanged) {
+                    engine.setParams(pendingParams);
+                    paramsChanged = false;
+                }
+            }
+
+            double convertMilliseconds = 0.0;
+            try {
+                ScopedTimer timer(convertMilliseconds);
+                engine.generatePreview(frame, ColoringPageEngine::shrinkToFit(frame.size(), previewBounds)).copyTo(backPage);
+            }
+            catch (cv::Exception&) {
+                // A bad frame or parameter set skips the frame; the next one tries again.
+                continue;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(bufferMutex);
+                std::swap(frontPage, backPage);
+                std::swap(frontFrame, frame);
+            }
+            if (!notifyPending.exchange(true)) {
+                QMetaObject::invokeMethod(this, [this]() {
+                    notifyPending = false;
+                    emit pageReady();
+                }, Qt::QueuedConnection);
+            }
+
+            ++pages;
+            convertTotal += convertMilliseconds;
+            double elapsed = std::chrono::duration<double>(Clock::now() - statsStart).count();
+            if (elapsed >= 1.0) {
+                double rate = pages / elapsed;
+                double meanMilliseconds = convertTotal / pages;
+                int dropped = droppedFrames;
+                QMetaObject::invokeMethod(this, [this, rate, meanMilliseconds, dropped]() {
+                    emit statsUpdated(rate, meanMilliseconds, dropped);
+                }, Qt::QueuedConnection);
+                statsStart = Clock::now();
+                pages = 0;
+                convertTotal = 0.0;
+            }
+        }
+    }
+
+    cv::VideoCapture capture;
+    cv::Size previewBounds;
+    Clock::duration frameBudget{};
+
+    // The newest camera frame not taken for conversion yet.
+    std::mutex frameMutex;
+    std::condition_variable frameArrived;
+    cv::Mat newestFrame;
+    bool frameWaiting = false;
+    std::atomic<bool> stopping{ false };
+    std::atomic<int> droppedFrames{ 0 };
+
+    std::mutex paramsMutex;
+    PipelineParams pendingParams = previewParams(PipelineParams());
+    bool paramsChanged = true;
+
+    mutable std::mutex bufferMutex;
+    cv::Mat frontPage;
+    cv::Mat frontFrame;
+    std::atomic<bool> notifyPending{ false };
+
+    std::thread captureThread;
+    std::thread convertThread;
+
+    static PipelineParams previewParams(PipelineParams params) {
+        params.edgeMethod = EdgeMethod::AdaptiveThreshold;
+        params.fusedThreshold = true;
+        params.tileSize = 0;
+        return params;
+    }
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <QImage>
+
+#include <opencv2/opencv.hpp>
+
+// Zero-copy views between cv::Mat and QImage.
+//
+// wrap() returns a QImage over the pixels of a Mat that shares ownership of the Mat's
+// buffer: the QImage keeps a reference through its cleanup function, so reassigning or
+// releasing the Mat never leaves it dangling, and dropping the QImage frees nothing the Mat
+// still uses. OpenCV's BGR order is labelled Format_BGR888, so nothing is converted.
+//
+// Writes through either side reach the shared pixels as long as the QImage is not copied: a
+// copied QImage detaches into a private buffer on its first write, as usual for QImage.
+class MatImage {
+public:
+    // CV_8UC3 (BGR) or CV_8UC1; other types return a null QImage.
+    static QImage wrap(const cv::Mat& mat) {
+        QImage::Format format = formatFor(mat.type());
+        if (mat.empty() || format == QImage::Format_Invalid) {
+            return QImage();
+        }
+
+        cv::Mat* owner = new cv::Mat(mat);
+        return QImage(owner->data, owner->cols, owner->rows, static_cast<qsizetype>(owner->step), format,
+            [](void* info) {
+                delete static_cast<cv::Mat*>(info);
+            }, owner);
+    }
+
+    // A Mat header over the pixels of image, valid while image is alive and not detached.
+    // Format_BGR888 maps to CV_8UC3 and Format_Grayscale8 to CV_8UC1; anything else gives an
+    // empty Mat.
+    static cv::Mat view(QImage& image) {
+        int type = typeFor(image.format());
+        if (image.isNull() || type < 0) {
+            return cv::Mat();
+        }
+        return cv::Mat(image.height(), image.width(), type, image.bits(), static_cast<size_t>(image.bytesPerLine()));
+    }
+
+private:
+    static QImage::Format formatFor(int type) {
+        switch (type) {
+        case CV_8UC3: return QImage::Format_BGR888;
+        case CV_8UC1: return QImage::Format_Grayscale8;
+        default: return QImage::Format_Invalid;
+        }
+    }
+
+    static int typeFor(QImage::Format format) {
+        switch (format) {
+        case QImage::Format_BGR888: return CV_8UC3;
+        case QImage::Format_Grayscale8: return CV_8UC1;
+        default: return -1;
+        }
+    }
+};
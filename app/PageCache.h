@@ -0,0 +1,163 @@
+#pragma once
+
+#include "ColoringPageEngine.h"
+#include "ImageIO.h"
+
+#include <QByteArray>
+#include <QCache>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QString>
+
+#include <opencv2/opencv.hpp>
+
+#include <algorithm>
+
+// Finished pages keyed by the source file's bytes, the pipeline parameters and the page
+// bounds. Recent pages stay in memory for the session; every page is also written to the
+// cache directory as PNG, which is lossless and small for line art. Both tiers evict the
+// least recently used pages beyond their budget; disk recency survives restarts through the
+// files' modification times.
+//
+// Pages go in and come out as deep copies, so callers may edit what they get. Not thread
+// safe; use from one thread.
+class PageCache {
+public:
+    explicit PageCache(const QString& directory, qint64 diskBudget = qint64(1024) << 20, qint64 memoryBudget = qint64(256) << 20)
+        : directory(directory), diskBudget(diskBudget), memory(static_cast<int>(memoryBudget >> 10)) {
+        QDir().mkpath(directory);
+        for (const QFileInfo& file : QDir(directory).entryInfoList({ "*.png" }, QDir::Files)) {
+            QByteArray key = QByteArray::fromHex(file.completeBaseName().toLatin1());
+            disk.insert(key, DiskEntry{ file.size(), file.lastModified().toMSecsSinceEpoch() });
+            diskUsage += file.size();
+        }
+        evict();
+    }
+
+    // Hash of the source file contents, computed once per source.
+    static QByteArray hashSource(const QByteArray& bytes) {
+        return QCryptographicHash::hash(bytes, QCryptographicHash::Blake2b_256);
+    }
+
+    static QByteArray key(const QByteArray& sourceHash, const PipelineParams& params, const cv::Size& bounds) {
+        QByteArray description;
+        QDataStream stream(&description, QIODevice::WriteOnly);
+        // Bump the version when the pipeline output changes; every new PipelineParams field
+        // belongs here as well.
+        stream << quint32(2) << sourceHash << bounds.width << bounds.height
+            << params.useOpenCL << params.fusedThreshold << qint32(params.edgeMethod) << params.thresholdBlockSize << params.thresholdC
+            << params.cannyLevels << params.cannyLow << params.cannyHigh << params.xdogSigma << params.xdogSharpness << params.xdogThreshold
+            << QString::fromStdString(params.lineArtModel)
+            << params.closingKernelSize << params.minContourArea << params.contourEpsilon << params.contourThickness
+            << params.maskClosingSize << params.gapAreaThreshold << params.inpaintRadius << params.tileSize;
+        return QCryptographicHash::hash(description, QCryptographicHash::Blake2b_256);
+    }
+
+    // The cached page, or an empty Mat on a miss.
+    cv::Mat find(const QByteArray& key) {
+        if (const cv::Mat* page = memory.object(key)) {
+            touchDisk(key);
+            return page->clone();
+        }
+
+        auto entry = disk.find(key);
+        if (entry == disk.end()) {
+            return cv::Mat();
+        }
+
+        cv::Mat page = ImageIO::load(pathFor(key));
+        if (page.empty()) {
+            // Unreadable entry, e.g. a write cut short: drop it.
+            removeFromDisk(key);
+            return cv::Mat();
+        }
+        touchDisk(key);
+        keepInMemory(key, page.clone());
+        return page;
+    }
+
+    void insert(const QByteArray& key, const cv::Mat& page) {
+        if (page.empty()) {
+            return;
+        }
+        keepInMemory(key, page.clone());
+
+        if (disk.contains(key)) {
+            touchDisk(key);
+            return;
+        }
+        QString path = pathFor(key);
+        if (!ImageIO::save(path, page)) {
+            QFile::remove(path);
+            return;
+        }
+        qint64 size = QFileInfo(path).size();
+        disk.insert(key, DiskEntry{ size, QDateTime::currentMSecsSinceEpoch() });
+        diskUsage += size;
+        evict();
+    }
+
+private:
+    struct DiskEntry {
+        qint64 size;
+        qint64 lastUsed;
+    };
+
+    QString pathFor(const QByteArray& key) const {
+        return QDir(directory).filePath(QString::fromLatin1(key.toHex()) + ".png");
+    }
+
+    void keepInMemory(const QByteArray& key, const cv::Mat& page) {
+        int costKb = static_cast<int>((page.total() * page.elemSize()) >> 10);
+        memory.insert(key, new cv::Mat(page), std::max(1, costKb));
+    }
+
+    void touchDisk(const QByteArray& key) {
+        auto entry = disk.find(key);
+        if (entry == disk.end()) {
+            return;
+        }
+        QDateTime now = QDateTime::currentDateTime();
+        entry->lastUsed = now.toMSecsSinceEpoch();
+        QFile file(pathFor(key));
+        if (file.open(QIODevice::ReadWrite)) {
+            file.setFileTime(now, QFileDevice::FileModificationTime);
+        }
+    }
+
+    void removeFromDisk(const QByteArray& key) {
+        auto entry = disk.find(key);
+        if (entry == disk.end()) {
+            return;
+        }
+        diskUsage -= entry->size;
+        disk.erase(entry);
+        QFile::remove(pathFor(key));
+    }
+
+    // Drops least recently used files until the directory fits the budget.
+    void evict() {
+        while (diskUsage > diskBudget && !disk.isEmpty()) {
+            auto oldest = disk.begin();
+            for (auto entry = disk.begin(); entry != disk.end(); ++entry) {
+                if (entry->lastUsed < oldest->lastUsed) {
+                    oldest = entry;
+                }
+            }
+            QByteArray key = oldest.key();
+            removeFromDisk(key);
+        }
+    }
+
+    QString directory;
+    qint64 diskBudget;
+    qint64 diskUsage = 0;
+    QHash<QByteArray, DiskEntry> disk;
+    // Cost in KiB, so the budget fits QCache's int.
+    QCache<QByteArray, cv::Mat> memory;
+};
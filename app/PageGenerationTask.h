@@ -0,0 +1,248 @@
+#pragma once
+
+#include "ColoringPageEngine.h"
+#include "ImageIO.h"
+#include "PageCache.h"
+#include "RegionIndex.h"
+
+#include <QObject>
+#include <QStandardPaths>
+#include <QString>
+#include <QThreadPool>
+
+#include <atomic>
+#include <memory>
+
+struct GeneratedPage {
+    cv::Mat page;
+    RegionIndex regions;
+    ColoringPageEngine::Profile profile;
+    // Time spent decoding the source; 0 when a cached source was regenerated.
+    double loadMilliseconds = 0.0;
+    // 1, 2, 4 or 8 when the source was decoded at that fraction of its resolution.
+    int decodeReduction = 1;
+    double indexMilliseconds = 0.0;
+};
+
+// Runs the generation pipeline for one image at a time on a background thread. Starting a
+// new run cancels the one in flight; only the latest run ever reports back. All signals are
+// emitted on the thread that owns the task. Finished pages are cached by source contents and
+// parameters, so reopening a photo or returning to earlier settings skips the pipeline.
+class PageGenerationTask : public QObject {
+    Q_OBJECT
+
+public:
+    PageGenerationTask(QObject* parent = nullptr)
+        : QObject(parent), cache(QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/pages") {
+        pool.setMaxThreadCount(1);
+    }
+
+    ~PageGenerationTask() {
+        cancel();
+        pool.waitForDone();
+    }
+
+    // Loads imagePath and generates a page scaled down to fit bounds; empty bounds keep the
+    // full resolution.
+    void start(const QString& imagePath, const cv::Size& bounds) {
+        currentImagePath = imagePath;
+        currentImage.release();
+        currentBounds = bounds;
+        launch(true);
+    }
+
+    // Like start(), for an image already in memory such as a camera frame. The task keeps
+    // image as it is, so the caller must not write to it afterwards. These pages have no file
+    // contents to key on and are not cached.
+    void startFromImage(const cv::Mat& image, const cv::Size& bounds) {
+        currentImagePath.clear();
+        currentImage = image;
+        currentBounds = bounds;
+        launch(true);
+    }
+
+    // Parameters for this and every later run. With an image already chosen the page is
+    // regenerated, starting at the first stage the change affects.
+    void setParams(const PipelineParams& params) {
+        currentParams = params;
+        if (!currentImagePath.isEmpty() || !currentImage.empty()) {
+            launch(false);
+        }
+    }
+
+    void cancel() {
+        if (currentCancelFlag) {
+            *currentCancelFlag = true;
+            currentCancelFlag.reset();
+        }
+        ++currentRun;
+        if (running) {
+            running = false;
+            emit canceled();
+        }
+    }
+
+    bool isRunning() const {
+        return running;
+    }
+
+signals:
+    void stageStarted(int stage, int stageCount, const QString& name);
+    void finished(const GeneratedPage& result);
+    void failed(const QString& message);
+    void canceled();
+
+private:
+    struct Request {
+        QString imagePath;
+        // Set instead of imagePath for startFromImage().
+        cv::Mat image;
+        cv::Size bounds;
+        PipelineParams params;
+        bool reload;
+    };
+
+    void launch(bool reload) {
+        cancel();
+
+        int run = ++currentRun;
+        auto cancelFlag = std::make_shared<std::atomic<bool>>(false);
+        currentCancelFlag = cancelFlag;
+        running = true;
+
+        Request request{ currentImagePath, currentImage, currentBounds, currentParams, reload };
+        pool.start([this, run, cancelFlag, request]() {
+            execute(run, *cancelFlag, request);
+        });
+    }
+
+    // Worker thread: everything that touches the window goes through deliver().
+    void execute(int run, const std::atomic<bool>& cancelFlag, const Request& request) {
+        auto onStage = [&](ColoringPageEngine::Stage stage) {
+            if (cancelFlag) {
+                return false;
+            }
+            int index = static_cast<int>(stage);
+            deliver(run, [this, index]() {
+                emit stageStarted(index, ColoringPageEngine::stageCount, ColoringPageEngine::stageName(static_cast<ColoringPageEngine::Stage>(index)));
+            });
+            return true;
+        };
+
+        try {
+            engine.setParams(request.params);
+
+            auto result = std::make_shared<GeneratedPage>();
+            const bool fromImage = !request.image.empty();
+            bool reload = request.reload
+                || (fromImage ? request.image.data != loadedImage.data : request.imagePath != loadedImagePath);
+            QByteArray bytes;
+            if (reload && !fromImage) {
+                ScopedTimer timer(result->loadMilliseconds);
+                bytes = ImageIO::read(request.imagePath);
+                loadedImagePath.clear();
+                loadedImage.release();
+                loadedSourceHash = PageCache::hashSource(bytes);
+            }
+
+            QByteArray cacheKey = fromImage ? QByteArray() : PageCache::key(loadedSourceHash, request.params, request.bounds);
+            cv::Mat cached = fromImage || (bytes.isEmpty() && reload) ? cv::Mat() : cache.find(cacheKey);
+            if (!cached.empty()) {
+                // The engine keeps whatever source it had; a reload hit leaves it without one,
+                // so a later parameter change loads the file again.
+                result->page = cached;
+                result->profile.firstStage = ColoringPageEngine::stageCount;
+                result->profile.backend = "Cache";
+            }
+            else if (reload && fromImage) {
+                loadedImagePath.clear();
+                loadedImage = request.image;
+                result->page = engine.generateColoringPage(request.image, ColoringPageEngine::shrinkToFit(request.image.size(), request.bounds), onStage);
+            }
+            else if (reload) {
+                cv::Mat image;
+                double decodeMilliseconds = 0.0;
+                {
+                    ScopedTimer timer(decodeMilliseconds);
+                    image = ImageIO::decode(bytes, request.bounds, &result->decodeReduction);
+                }
+                result->loadMilliseconds += decodeMilliseconds;
+                bytes.clear();
+                if (image.empty()) {
+                    deliver(run, [this]() {
+                        running = false;
+                        currentImagePath.clear();
+                        emit failed("Failed to load the image.");
+                    });
+                    return;
+                }
+                loadedImagePath = request.imagePath;
+                result->page = engine.generateColoringPage(image, ColoringPageEngine::shrinkToFit(image.size(), request.bounds), onStage);
+            }
+            else {
+                result->page = engine.regenerate(onStage);
+            }
+
+            if (result->page.empty() || cancelFlag) {
+                return;
+            }
+
+            // The window edits the delivered page, so the cache encodes a snapshot, after
+            // the page is on its way.
+            cv::Mat snapshot;
+            if (cached.empty()) {
+                result->profile = engine.lastProfile();
+                if (!cacheKey.isEmpty()) {
+                    snapshot = result->page.clone();
+                }
+            }
+            {
+                ScopedTimer timer(result->indexMilliseconds);
+                result->regions.build(result->page);
+            }
+
+            deliver(run, [this, result]() {
+                running = false;
+                emit finished(*result);
+            });
+
+            if (!snapshot.empty()) {
+                cache.insert(cacheKey, snapshot);
+            }
+        }
+        catch (cv::Exception& e) {
+            QString message = QString("Failed to generate coloring page: %1").arg(e.what());
+            deliver(run, [this, message]() {
+                running = false;
+                emit failed(message);
+            });
+        }
+    }
+
+    template <typename Function>
+    void deliver(int run, Function function) {
+        QMetaObject::invokeMethod(this, [this, run, function]() {
+            if (run == currentRun) {
+                function();
+            }
+        }, Qt::QueuedConnection);
+    }
+
+    QThreadPool pool;
+
+    // Owned by the worker thread.
+    ColoringPageEngine engine;
+    QString loadedImagePath;
+    cv::Mat loadedImage;
+    QByteArray loadedSourceHash;
+    PageCache cache;
+
+    // Owned by the task's thread.
+    QString currentImagePath;
+    cv::Mat currentImage;
+    cv::Size currentBounds;
+    PipelineParams currentParams;
+    int currentRun = 0;
+    std::shared_ptr<std::atomic<bool>> currentCancelFlag;
+    bool running = false;
+};
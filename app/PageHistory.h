@@ -0,0 +1,171 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+// Undo/redo for an edited page. Only the bounding rectangle of each change is kept, as
+// PNG-compressed before/after patches, and the oldest steps are dropped once the patches
+// exceed the memory budget.
+class PageHistory {
+public:
+    static const size_t defaultMemoryBudget = 256 * 1024 * 1024;
+
+    explicit PageHistory(size_t memoryBudget = defaultMemoryBudget) : budget(memoryBudget) {
+    }
+
+    // Starts a new history with page as its base state.
+    void reset(const cv::Mat& page) {
+        reference = page.clone();
+        undoSteps.clear();
+        redoSteps.clear();
+        deltaBytes = 0;
+    }
+
+    // Records everything that changed in page since the last recorded state. When region is
+    // given only that part of the page is compared. Returns false if nothing changed.
+    bool commit(const cv::Mat& page, const cv::Rect& region = cv::Rect()) {
+        if (reference.empty() || page.size() != reference.size() || page.type() != reference.type()) {
+            reset(page);
+            return false;
+        }
+
+        cv::Rect pageRect(0, 0, page.cols, page.rows);
+        cv::Rect searchRect = region.area() > 0 ? region & pageRect : pageRect;
+        if (searchRect.empty()) {
+            return false;
+        }
+
+        cv::Rect changed = changedRect(reference(searchRect), page(searchRect));
+        if (changed.empty()) {
+            return false;
+        }
+        changed += searchRect.tl();
+
+        Delta delta;
+        delta.rect = changed;
+        encode(reference(changed), delta.before);
+        encode(page(changed), delta.after);
+        page(changed).copyTo(reference(changed));
+
+        for (const Delta& undone : redoSteps) {
+            deltaBytes -= undone.bytes();
+        }
+        redoSteps.clear();
+
+        deltaBytes += delta.bytes();
+        undoSteps.push_back(std::move(delta));
+        trim();
+        return true;
+    }
+
+    // Restores the state before the last recorded change. changedRegion receives the
+    // rectangle of page that was rewritten.
+    bool undo(cv::Mat& page, cv::Rect* changedRegion = nullptr) {
+        if (undoSteps.empty()) {
+            return false;
+        }
+
+        Delta delta = std::move(undoSteps.back());
+        undoSteps.pop_back();
+        apply(delta.before, delta.rect, page);
+        if (changedRegion) {
+            *changedRegion = delta.rect;
+        }
+        redoSteps.push_back(std::move(delta));
+        return true;
+    }
+
+    bool redo(cv::Mat& page, cv::Rect* changedRegion = nullptr) {
+        if (redoSteps.empty()) {
+            return false;
+        }
+
+        Delta delta = std::move(redoSteps.back());
+        redoSteps.pop_back();
+        apply(delta.after, delta.rect, page);
+        if (changedRegion) {
+            *changedRegion = delta.rect;
+        }
+        undoSteps.push_back(std::move(delta));
+        return true;
+    }
+
+    bool canUndo() const {
+        return !undoSteps.empty();
+    }
+
+    bool canRedo() const {
+        return !redoSteps.empty();
+    }
+
+    void setMemoryBudget(size_t bytes) {
+        budget = bytes;
+        trim();
+    }
+
+    size_t memoryBudget() const {
+        return budget;
+    }
+
+    // Bytes held by the recorded patches plus the base copy of the page.
+    size_t memoryUsage() const {
+        return deltaBytes + reference.total() * reference.elemSize();
+    }
+
+private:
+    struct Delta {
+        cv::Rect rect;
+        std::vector<uchar> before;
+        std::vector<uchar> after;
+
+        size_t bytes() const {
+            return before.size() + after.size();
+        }
+    };
+
+    static cv::Rect changedRect(const cv::Mat& before, const cv::Mat& after) {
+        cv::Mat difference;
+        cv::absdiff(before, after, difference);
+
+        // One byte per channel, so x is in channel units until it is scaled back.
+        cv::Rect bytes = cv::boundingRect(difference.reshape(1));
+        if (bytes.empty()) {
+            return cv::Rect();
+        }
+
+        int channels = before.channels();
+        int left = bytes.x / channels;
+        int right = (bytes.x + bytes.width - 1) / channels;
+        return cv::Rect(left, bytes.y, right - left + 1, bytes.height);
+    }
+
+    static void encode(const cv::Mat& patch, std::vector<uchar>& buffer) {
+        cv::imencode(".png", patch, buffer, { cv::IMWRITE_PNG_COMPRESSION, 1 });
+    }
+
+    void apply(const std::vector<uchar>& buffer, const cv::Rect& rect, cv::Mat& page) {
+        cv::Mat patch = cv::imdecode(buffer, cv::IMREAD_UNCHANGED);
+        patch.copyTo(page(rect));
+        patch.copyTo(reference(rect));
+    }
+
+    void trim() {
+        while (deltaBytes > budget && !undoSteps.empty()) {
+            deltaBytes -= undoSteps.front().bytes();
+            undoSteps.pop_front();
+        }
+        while (deltaBytes > budget && !redoSteps.empty()) {
+            deltaBytes -= redoSteps.front().bytes();
+            redoSteps.erase(redoSteps.begin());
+        }
+    }
+
+    cv::Mat reference;
+    std::deque<Delta> undoSteps;
+    std::vector<Delta> redoSteps;
+    size_t deltaBytes = 0;
+    size_t budget;
+};
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+
+#include <cstring>
+
+// Pixel loops for the exact formats the app edits: CV_8UC3 pages, CV_8U masks and the
+// CV_32S labels' row spans. The channel count is a template parameter, so every kernel is a
+// fixed-stride loop with no per-call type dispatch, where Mat::setTo and bitwise_and pick
+// their implementation at run time on every call. Rows are written as fixed-size blocks or
+// branch-free element-wise loops that the compiler turns into vector loads and stores, so
+// an edit on a large page runs at memory speed.
+class PixelKernels {
+public:
+    template <int Channels>
+    using Pixel = cv::Vec<uchar, Channels>;
+
+    // Sets count pixels from row to color.
+    template <int Channels>
+    static void fillRow(uchar* row, int count, const Pixel<Channels>& color) {
+        if (Channels == 1) {
+            std::memset(row, color[0], count);
+            return;
+        }
+        const Block<Channels> block(color);
+        int x = 0;
+        for (; x + blockPixels <= count; x += blockPixels) {
+            std::memcpy(row + x * Channels, block.bytes, sizeof(block.bytes));
+        }
+        std::memcpy(row + x * Channels, block.bytes, (count - x) * Channels);
+    }
+
+    // Whether count pixels from row all equal color.
+    template <int Channels>
+    static bool rowEquals(const uchar* row, int count, const Pixel<Channels>& color) {
+        const Block<Channels> block(color);
+        int x = 0;
+        for (; x + blockPixels <= count; x += blockPixels) {
+            if (std::memcmp(row + x * Channels, block.bytes, sizeof(block.bytes)) != 0) {
+                return false;
+            }
+        }
+        return std::memcmp(row + x * Channels, block.bytes, (count - x) * Channels) == 0;
+    }
+
+    // Paints image with color wherever mask holds maskValue, and clears those mask pixels:
+    // the result of a flood fill applied and its mask reset in one pass.
+    template <int Channels>
+    static void paintAndClear(cv::Mat image, cv::Mat mask, uchar maskValue, const Pixel<Channels>& color) {
+        CV_Assert(image.type() == CV_8UC(Channels) && mask.type() == CV_8U && image.size() == mask.size());
+        for (int y = 0; y < image.rows; ++y) {
+            uchar* pixels = image.ptr<uchar>(y);
+            uchar* marks = mask.ptr<uchar>(y);
+            for (int x = 0; x < image.cols; ++x) {
+                if (marks[x] == maskValue) {
+                    for (int c = 0; c < Channels; ++c) {
+                        pixels[x * Channels + c] = color[c];
+                    }
+                    marks[x] = 0;
+                }
+            }
+        }
+    }
+
+    // destination = foreground where mask is set, background elsewhere; allocates
+    // destination at the mask's size. One pass instead of a fill and a masked setTo.
+    template <int Channels>
+    static void select(const cv::Mat& mask, cv::Mat& destination, const Pixel<Channels>& foreground, const Pixel<Channels>& background) {
+        CV_Assert(mask.type() == CV_8U);
+        destination.create(mask.size(), CV_8UC(Channels));
+        Pixel<Channels> difference;
+        for (int c = 0; c < Channels; ++c) {
+            difference[c] = foreground[c] ^ background[c];
+        }
+        for (int y = 0; y < mask.rows; ++y) {
+            const uchar* marks = mask.ptr<uchar>(y);
+            uchar* pixels = destination.ptr<uchar>(y);
+            for (int x = 0; x < mask.cols; ++x) {
+                const uchar all = static_cast<uchar>(0 - (marks[x] != 0));
+                for (int c = 0; c < Channels; ++c) {
+                    pixels[x * Channels + c] = background[c] ^ (difference[c] & all);
+                }
+            }
+        }
+    }
+
+    // Zeroes image wherever mask is zero, in place.
+    template <int Channels>
+    static void applyMask(cv::Mat& image, const cv::Mat& mask) {
+        CV_Assert(image.type() == CV_8UC(Channels) && mask.type() == CV_8U && image.size() == mask.size());
+        for (int y = 0; y < image.rows; ++y) {
+            uchar* pixels = image.ptr<uchar>(y);
+            const uchar* marks = mask.ptr<uchar>(y);
+            for (int x = 0; x < image.cols; ++x) {
+                const uchar all = static_cast<uchar>(0 - (marks[x] != 0));
+                for (int c = 0; c < Channels; ++c) {
+                    pixels[x * Channels + c] &= all;
+                }
+            }
+        }
+    }
+
+private:
+    // Pixels per fixed-size block: 48 bytes for BGR, three 16-byte vectors.
+    static constexpr int blockPixels = 16;
+
+    template <int Channels>
+    struct Block {
+        explicit Block(const Pixel<Channels>& color) {
+            for (int x = 0; x < blockPixels; ++x) {
+                for (int c = 0; c < Channels; ++c) {
+                    bytes[x * Channels + c] = color[c];
+                }
+            }
+        }
+
+        uchar bytes[blockPixels * Channels];
+    };
+};
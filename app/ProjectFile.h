@@ -0,0 +1,242 @@
+#pragma once
+
+#include <QByteArray>
+#include <QColor>
+#include <QDataStream>
+#include <QFile>
+#include <QPointF>
+#include <QString>
+#include <QThreadPool>
+#include <QtGlobal>
+
+#include <opencv2/opencv.hpp>
+
+#include <memory>
+#include <vector>
+
+// One edit of a page, in the order the user made it. Replaying the operations on the line
+// art with the same fill and stroke code reproduces the page and its undo history exactly.
+struct PageOperation {
+    enum Kind : quint8 {
+        Fill = 1,
+        FillAllOfColor,
+        Stroke,
+        Undo,
+        Redo,
+    };
+
+    Kind kind = Fill;
+    QRgb color = 0;
+    // The brush width of a stroke at full pressure.
+    float width = 1.0f;
+    // The seed of a fill, the points of a stroke; empty for undo and redo.
+    std::vector<QPointF> points;
+    // One per stroke point.
+    std::vector<float> pressures;
+    // Whether a fill stopped at the gap barrier of the page's region index.
+    bool closeGaps = false;
+};
+
+// A coloring session on disk: the line art once, as PNG, followed by an append-only log of
+// page operations. Every record carries its length and a checksum, so a log cut short by a
+// crash reads back up to the last complete operation.
+//
+// Writes happen on a background thread in the order they were made. append() only buffers;
+// flush() hands the buffered records to the writer as one small write, so an autosave timer
+// costs the GUI thread nothing but the encoding of a few operations.
+class ProjectFile {
+public:
+    struct Contents {
+        cv::Mat lineArt;
+        std::vector<PageOperation> operations;
+        // Bytes up to the end of the last complete record.
+        qint64 validSize = 0;
+        // False for a file in an older format, which resume() must not append to.
+        bool currentFormat = false;
+    };
+
+    ProjectFile() {
+        writer.setMaxThreadCount(1);
+    }
+
+    ~ProjectFile() {
+        flush();
+        writer.waitForDone();
+    }
+
+    ProjectFile(const ProjectFile&) = delete;
+    ProjectFile& operator=(const ProjectFile&) = delete;
+
+    // Starts path over with lineArt as the base page and an empty log.
+    void create(const QString& path, const cv::Mat& lineArt) {
+        flush();
+        file = std::make_shared<QFile>(path);
+        cv::Mat snapshot = lineArt.clone();
+        writer.start([target = file, snapshot]() {
+            std::vector<uchar> png;
+            if (!target->open(QIODevice::WriteOnly | QIODevice::Truncate) || !cv::imencode(".png", snapshot, png)) {
+                qWarning("Failed to start the project file %s", qUtf8Printable(target->fileName()));
+                return;
+            }
+            QByteArray header;
+            QDataStream out(&header, QIODevice::WriteOnly);
+            out << magic << version;
+            target->write(header);
+            target->write(record(QByteArray(reinterpret_cast<const char*>(png.data()), static_cast<qsizetype>(png.size()))));
+            target->flush();
+        });
+    }
+
+    // Continues appending to a project read with read(), dropping any incomplete record at
+    // its end.
+    void resume(const QString& path, qint64 validSize) {
+        flush();
+        file = std::make_shared<QFile>(path);
+        writer.start([target = file, validSize]() {
+            if (!target->open(QIODevice::ReadWrite) || !target->resize(validSize) || !target->seek(validSize)) {
+                qWarning("Failed to reopen the project file %s", qUtf8Printable(target->fileName()));
+            }
+        });
+    }
+
+    void close() {
+        flush();
+        file.reset();
+    }
+
+    bool isOpen() const {
+        return file != nullptr;
+    }
+
+    void append(const PageOperation& operation) {
+        if (!file) {
+            return;
+        }
+        QByteArray payload;
+        QDataStream out(&payload, QIODevice::WriteOnly);
+        out.setFloatingPointPrecision(QDataStream::SinglePrecision);
+        out << quint8(operation.kind) << quint8(operation.closeGaps) << quint32(operation.color) << operation.width << quint32(operation.points.size());
+        for (size_t i = 0; i < operation.points.size(); ++i) {
+            float pressure = i < operation.pressures.size() ? operation.pressures[i] : 1.0f;
+            out << float(operation.points[i].x()) << float(operation.points[i].y()) << pressure;
+        }
+        pending += record(payload);
+    }
+
+    void flush() {
+        if (!file || pending.isEmpty()) {
+            return;
+        }
+        QByteArray bytes = pending;
+        pending.clear();
+        writer.start([target = file, bytes]() {
+            if (target->isOpen() && (target->write(bytes) != bytes.size() || !target->flush())) {
+                qWarning("Failed to autosave to %s", qUtf8Printable(target->fileName()));
+            }
+        });
+    }
+
+    // Flushes and waits until everything is on disk, e.g. before copying the file.
+    void sync() {
+        flush();
+        writer.waitForDone();
+    }
+
+    // Returns false when path is not a project or its line art is unreadable. A damaged log
+    // still yields every operation before the damage.
+    static bool read(const QString& path, Contents& contents) {
+        QFile source(path);
+        if (!source.open(QIODevice::ReadOnly)) {
+            return false;
+        }
+        QByteArray bytes = source.readAll();
+        QDataStream in(bytes);
+
+        quint32 fileMagic = 0;
+        quint32 fileVersion = 0;
+        in >> fileMagic >> fileVersion;
+        QByteArray payload;
+        if (fileMagic != magic || fileVersion < firstReadableVersion || fileVersion > version || !readRecord(in, payload)) {
+            return false;
+        }
+        contents.lineArt = cv::imdecode(cv::Mat(1, static_cast<int>(payload.size()), CV_8U, payload.data()), cv::IMREAD_COLOR);
+        if (contents.lineArt.empty()) {
+            return false;
+        }
+        contents.validSize = in.device()->pos();
+        contents.currentFormat = fileVersion == version;
+
+        contents.operations.clear();
+        while (readRecord(in, payload)) {
+            QDataStream fields(payload);
+            fields.setFloatingPointPrecision(QDataStream::SinglePrecision);
+            quint8 kind = 0;
+            quint8 closeGaps = 0;
+            quint32 color = 0;
+            float width = 1.0f;
+            quint32 count = 0;
+            fields >> kind;
+            if (fileVersion >= 3) {
+                fields >> closeGaps;
+            }
+            fields >> color >> width >> count;
+            if (kind < PageOperation::Fill || kind > PageOperation::Redo || count > static_cast<quint32>(payload.size() / 12)) {
+                break;
+            }
+
+            PageOperation operation;
+            operation.kind = static_cast<PageOperation::Kind>(kind);
+            operation.color = color;
+            operation.width = width;
+            operation.closeGaps = closeGaps != 0;
+            operation.points.resize(count);
+            operation.pressures.resize(count);
+            for (quint32 i = 0; i < count; ++i) {
+                float x = 0.0f;
+                float y = 0.0f;
+                fields >> x >> y >> operation.pressures[i];
+                operation.points[i] = QPointF(x, y);
+            }
+            if (fields.status() != QDataStream::Ok) {
+                break;
+            }
+            contents.operations.push_back(std::move(operation));
+            contents.validSize = in.device()->pos();
+        }
+        return true;
+    }
+
+private:
+    static constexpr quint32 magic = 0x43505052;
+    // Version 2 stores points as floats with a pressure each, and a brush width per stroke.
+    // Version 3 adds whether a fill closed gaps; version 2 fills did not.
+    static constexpr quint32 version = 3;
+    static constexpr quint32 firstReadableVersion = 2;
+
+    static QByteArray record(const QByteArray& payload) {
+        QByteArray bytes;
+        QDataStream out(&bytes, QIODevice::WriteOnly);
+        out << quint32(payload.size());
+        out.writeRawData(payload.constData(), static_cast<int>(payload.size()));
+        out << quint16(qChecksum(payload));
+        return bytes;
+    }
+
+    static bool readRecord(QDataStream& in, QByteArray& payload) {
+        quint32 size = 0;
+        in >> size;
+        if (in.status() != QDataStream::Ok || in.device()->bytesAvailable() < qint64(size) + 2) {
+            return false;
+        }
+        payload.resize(size);
+        in.readRawData(payload.data(), static_cast<int>(size));
+        quint16 checksum = 0;
+        in >> checksum;
+        return in.status() == QDataStream::Ok && checksum == qChecksum(payload);
+    }
+
+    // Shared with the writer's queued tasks; only they touch the file itself.
+    std::shared_ptr<QFile> file;
+    QByteArray pending;
+    QThreadPool writer;
+};
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+
+#include <algorithm>
+
+// Dilation and erosion with a MORPH_RECT kernel in time independent of the kernel size.
+// The rectangle is split into a column and a row pass, and each pass uses the van Herk /
+// Gil-Werman running max/min: three max/min operations per pixel, done a whole row at a time
+// with OpenCV's vectorized cv::max/cv::min. The row pass runs on the transposed image so it
+// is a column pass as well.
+//
+// Output is identical to cv::dilate/cv::erode with the default anchor and border, where
+// pixels outside the image never win. Types other than CV_8UC1 go straight to OpenCV.
+// Keeps scratch buffers between calls, so use one instance per thread.
+class RectMorphology {
+public:
+    void dilate(const cv::Mat& src, cv::Mat& dst, const cv::Size& kernelSize) {
+        apply(src, dst, kernelSize, true);
+    }
+
+    void erode(const cv::Mat& src, cv::Mat& dst, const cv::Size& kernelSize) {
+        apply(src, dst, kernelSize, false);
+    }
+
+private:
+    void apply(const cv::Mat& src, cv::Mat& dst, const cv::Size& kernelSize, bool useMax) {
+        if (src.type() != CV_8UC1 || src.empty() || kernelSize.width < 1 || kernelSize.height < 1) {
+            cv::Mat kernel = cv::getStructuringElement(cv::MORPH_RECT, kernelSize);
+            if (useMax) {
+                cv::dilate(src, dst, kernel);
+            }
+            else {
+                cv::erode(src, dst, kernel);
+            }
+            return;
+        }
+
+        columnPass(src, columnResult, kernelSize.height, useMax);
+
+        if (kernelSize.width == 1) {
+            columnResult.copyTo(dst);
+            return;
+        }
+
+        cv::transpose(columnResult, transposed);
+        columnPass(transposed, transposedResult, kernelSize.width, useMax);
+        cv::transpose(transposedResult, dst);
+    }
+
+    // dst.row(y) = max/min of src rows [y - k/2, y - k/2 + k - 1], rows outside src ignored.
+    void columnPass(const cv::Mat& src, cv::Mat& dst, int k, bool useMax) {
+        if (k == 1) {
+            src.copyTo(dst);
+            return;
+        }
+
+        const int rows = src.rows;
+        const int anchor = k / 2;
+        const int padded = rows + k - 1;
+
+        neutralRow.create(1, src.cols, CV_8U);
+        neutralRow.setTo(cv::Scalar(useMax ? 0 : 255));
+
+        // Padded row i is source row i - anchor, or the neutral row outside the image.
+        auto paddedRow = [&](int i) {
+            int y = i - anchor;
+            return (y >= 0 && y < rows) ? src.row(y) : neutralRow;
+        };
+        auto combine = [useMax](const cv::Mat& a, const cv::Mat& b, cv::Mat out) {
+            if (useMax) {
+                cv::max(a, b, out);
+            }
+            else {
+                cv::min(a, b, out);
+            }
+        };
+
+        // prefix: running result from the start of each block of k padded rows.
+        // suffix: running result from the end of each block.
+        prefix.create(padded, src.cols, CV_8U);
+        suffix.create(padded, src.cols, CV_8U);
+
+        for (int i = 0; i < padded; ++i) {
+            if (i % k == 0) {
+                paddedRow(i).copyTo(prefix.row(i));
+            }
+            else {
+                combine(prefix.row(i - 1), paddedRow(i), prefix.row(i));
+            }
+        }
+
+        for (int i = padded - 1; i >= 0; --i) {
+            if (i % k == k - 1 || i == padded - 1) {
+                paddedRow(i).copyTo(suffix.row(i));
+            }
+            else {
+                combine(suffix.row(i + 1), paddedRow(i), suffix.row(i));
+            }
+        }
+
+        // The window [y, y + k - 1] spans at most two blocks: the tail of the one holding y
+        // and the head of the one holding y + k - 1.
+        dst.create(rows, src.cols, CV_8U);
+        for (int y = 0; y < rows; ++y) {
+            combine(suffix.row(y), prefix.row(y + k - 1), dst.row(y));
+        }
+    }
+
+    cv::Mat columnResult;
+    cv::Mat transposed;
+    cv::Mat transposedResult;
+    cv::Mat neutralRow;
+    cv::Mat prefix;
+    cv::Mat suffix;
+};
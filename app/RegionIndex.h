@@ -0,0 +1,250 @@
+#pragma once
+
+#include "PixelKernels.h"
+#include "RectMorphology.h"
+
+#include <opencv2/opencv.hpp>
+
+#include <algorithm>
+#include <vector>
+
+// Fillable regions of a finished page: the 4-connected areas of paper color, labelled once
+// with their bounding boxes and row spans. Looking up the region under a point is O(1) and
+// painting a region is O(region), with no flood traversal.
+//
+// The index also keeps a gap barrier: paper pixels that a small closing of the lines would
+// cover, i.e. breaks in the line art up to gapSize wide. They stay paper on the page, but
+// belong to no region, and fills made with closeGaps treat them as lines, so a fill stops at
+// a broken outline instead of leaking into the neighbouring area.
+class RegionIndex {
+public:
+    struct Span {
+        int y;
+        int x0;
+        int x1;
+    };
+
+    // Widest break in a line that the gap barrier closes, in page pixels.
+    static constexpr int defaultGapSize = 5;
+
+    // Barrier pixels in labelImage().
+    static constexpr int barrierLabel = -1;
+
+    // Rebuilds the index from a CV_8UC3 page; pixels equal to paper are what gets labelled.
+    // gapSize 0 builds no barrier.
+    void build(const cv::Mat& page, int gapSize = defaultGapSize, const cv::Vec3b& paper = cv::Vec3b(255, 255, 255)) {
+        clear();
+        if (page.empty() || page.type() != CV_8UC3) {
+            return;
+        }
+
+        cv::Mat paperMask;
+        cv::inRange(page, cv::Scalar(paper[0], paper[1], paper[2]), cv::Scalar(paper[0], paper[1], paper[2]), paperMask);
+
+        // Closing the lines bridges their breaks; what it adds on paper is the barrier.
+        cv::Mat regionMask = paperMask;
+        if (gapSize > 0) {
+            RectMorphology morphology;
+            cv::Mat lines;
+            cv::Mat dilated;
+            cv::Mat closed;
+            cv::Size kernelSize(gapSize + 1, gapSize + 1);
+            cv::bitwise_not(paperMask, lines);
+            morphology.dilate(lines, dilated, kernelSize);
+            morphology.erode(dilated, closed, kernelSize);
+            cv::bitwise_and(closed, paperMask, gapBarrier);
+            regionMask = paperMask & ~gapBarrier;
+        }
+
+        cv::Mat stats;
+        cv::Mat centroids;
+        int labelCount = cv::connectedComponentsWithStats(regionMask, labels, stats, centroids, 4, CV_32S);
+        if (!gapBarrier.empty()) {
+            labels.setTo(barrierLabel, gapBarrier);
+        }
+
+        regionBounds.resize(labelCount);
+        regionAreas.resize(labelCount);
+        for (int label = 1; label < labelCount; ++label) {
+            regionBounds[label] = cv::Rect(stats.at<int>(label, cv::CC_STAT_LEFT), stats.at<int>(label, cv::CC_STAT_TOP),
+                stats.at<int>(label, cv::CC_STAT_WIDTH), stats.at<int>(label, cv::CC_STAT_HEIGHT));
+            regionAreas[label] = stats.at<int>(label, cv::CC_STAT_AREA);
+        }
+
+        // Two passes over the labels: count the spans of every region, then place them.
+        spanOffsets.assign(labelCount + 1, 0);
+        forEachSpan([this](int label, const Span&) {
+            ++spanOffsets[label + 1];
+        });
+        for (int label = 0; label < labelCount; ++label) {
+            spanOffsets[label + 1] += spanOffsets[label];
+        }
+
+        spanStorage.resize(spanOffsets[labelCount]);
+        std::vector<int> next(spanOffsets.begin(), spanOffsets.end() - 1);
+        forEachSpan([this, &next](int label, const Span& span) {
+            spanStorage[next[label]++] = span;
+        });
+    }
+
+    void clear() {
+        labels.release();
+        gapBarrier.release();
+        regionBounds.clear();
+        regionAreas.clear();
+        spanOffsets.clear();
+        spanStorage.clear();
+    }
+
+    bool empty() const {
+        return regionBounds.size() < 2;
+    }
+
+    // Region under point, or 0 when point is on a line, on the barrier or outside the page.
+    int regionAt(const cv::Point& point) const {
+        if (labels.empty() || point.x < 0 || point.y < 0 || point.x >= labels.cols || point.y >= labels.rows) {
+            return 0;
+        }
+        return std::max(0, labels.at<int>(point));
+    }
+
+    int regionCount() const {
+        return empty() ? 0 : static_cast<int>(regionBounds.size()) - 1;
+    }
+
+    const cv::Rect& bounds(int region) const {
+        return regionBounds[region];
+    }
+
+    int area(int region) const {
+        return regionAreas[region];
+    }
+
+    const Span* spansBegin(int region) const {
+        return spanStorage.data() + spanOffsets[region];
+    }
+
+    const Span* spansEnd(int region) const {
+        return spanStorage.data() + spanOffsets[region + 1];
+    }
+
+    const cv::Mat& labelImage() const {
+        return labels;
+    }
+
+    // CV_8U, 255 on the barrier; empty when the index was built with gapSize 0.
+    const cv::Mat& barrier() const {
+        return gapBarrier;
+    }
+
+    // Paints region with color if that is exactly what a flood fill seeded inside it would do:
+    // the region still has a single color and no neighbouring pixel shares it. With closeGaps
+    // the flood fill is one that stops at the barrier. Returns false otherwise (e.g. after
+    // strokes crossed it), leaving the page untouched for the caller to fall back to a flood
+    // fill.
+    bool fillRegion(cv::Mat& page, int region, const cv::Vec3b& color, bool closeGaps, cv::Rect* filled = nullptr) const {
+        if (!isValidRegion(page, region)) {
+            return false;
+        }
+
+        cv::Vec3b current = page.at<cv::Vec3b>(spansBegin(region)->y, spansBegin(region)->x0);
+        if (!isIsolated(page, region, current, closeGaps)) {
+            return false;
+        }
+
+        paint(page, region, color);
+        if (filled) {
+            *filled = regionBounds[region];
+        }
+        return true;
+    }
+
+    // Paints every isolated region currently colored from. Returns the union of the painted
+    // regions' bounds.
+    cv::Rect fillAllOfColor(cv::Mat& page, const cv::Vec3b& from, const cv::Vec3b& color, bool closeGaps) const {
+        cv::Rect filled;
+        if (page.size() != labels.size() || page.type() != CV_8UC3) {
+            return filled;
+        }
+
+        for (int region = 1; region < static_cast<int>(regionBounds.size()); ++region) {
+            const Span* first = spansBegin(region);
+            if (page.at<cv::Vec3b>(first->y, first->x0) != from || !isIsolated(page, region, from, closeGaps)) {
+                continue;
+            }
+            paint(page, region, color);
+            filled = filled.empty() ? regionBounds[region] : (filled | regionBounds[region]);
+        }
+        return filled;
+    }
+
+private:
+    template <typename Visitor>
+    void forEachSpan(Visitor visit) const {
+        for (int y = 0; y < labels.rows; ++y) {
+            const int* row = labels.ptr<int>(y);
+            int x = 0;
+            while (x < labels.cols) {
+                int label = row[x];
+                int start = x;
+                while (x < labels.cols && row[x] == label) {
+                    ++x;
+                }
+                if (label > 0) {
+                    visit(label, Span{ y, start, x });
+                }
+            }
+        }
+    }
+
+    bool isValidRegion(const cv::Mat& page, int region) const {
+        return region > 0 && region < static_cast<int>(regionBounds.size())
+            && page.size() == labels.size() && page.type() == CV_8UC3;
+    }
+
+    // With closeGaps, neighbours on the barrier are walls whatever their color.
+    bool isIsolated(const cv::Mat& page, int region, const cv::Vec3b& color, bool closeGaps) const {
+        auto joins = [&color, closeGaps](const cv::Vec3b* row, const int* rowLabels, int x) {
+            return row[x] == color && !(closeGaps && rowLabels[x] == barrierLabel);
+        };
+
+        for (const Span* span = spansBegin(region); span != spansEnd(region); ++span) {
+            if (!PixelKernels::rowEquals<3>(page.ptr<uchar>(span->y, span->x0), span->x1 - span->x0, color)) {
+                return false;
+            }
+
+            const cv::Vec3b* row = page.ptr<cv::Vec3b>(span->y);
+            const int* spanLabels = labels.ptr<int>(span->y);
+            if ((span->x0 > 0 && joins(row, spanLabels, span->x0 - 1)) || (span->x1 < page.cols && joins(row, spanLabels, span->x1))) {
+                return false;
+            }
+
+            for (int y = span->y - 1; y <= span->y + 1; y += 2) {
+                if (y < 0 || y >= page.rows) {
+                    continue;
+                }
+                const cv::Vec3b* neighbourRow = page.ptr<cv::Vec3b>(y);
+                const int* neighbourLabels = labels.ptr<int>(y);
+                for (int x = span->x0; x < span->x1; ++x) {
+                    if (neighbourLabels[x] != region && joins(neighbourRow, neighbourLabels, x)) {
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    void paint(cv::Mat& page, int region, const cv::Vec3b& color) const {
+        for (const Span* span = spansBegin(region); span != spansEnd(region); ++span) {
+            PixelKernels::fillRow<3>(page.ptr<uchar>(span->y, span->x0), span->x1 - span->x0, color);
+        }
+    }
+
+    cv::Mat labels;
+    cv::Mat gapBarrier;
+    std::vector<cv::Rect> regionBounds;
+    std::vector<int> regionAreas;
+    std::vector<int> spanOffsets;
+    std::vector<Span> spanStorage;
+};
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <chrono>
+
+// Writes the milliseconds between construction and destruction into target.
+class ScopedTimer {
+public:
+    explicit ScopedTimer(double& target) : target(target), start(std::chrono::steady_clock::now()) {
+    }
+
+    ~ScopedTimer() {
+        target = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    double& target;
+    std::chrono::steady_clock::time_point start;
+};
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <QColor>
+#include <QImage>
+#include <QLineF>
+#include <QPainter>
+#include <QPen>
+#include <QPointF>
+#include <QRect>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Freehand strokes with a brush width and pen pressure. A stroke keeps one QPainter on the
+// page image from begin() to end(). Input points only queue up, and flush() draws everything
+// queued since the last flush in one pass. The window flushes once per frame, however fast
+// the pen reports: a 1000 Hz tablet costs one painter pass per frame, not one per event.
+//
+// Every segment is its own round-capped line, with a width that follows the pressure at its
+// two ends. Segments are not merged into polylines, so the pixels do not depend on how the
+// frames split the stroke, and replaying the recorded points in one flush gives the same
+// page. Points and pressures are rounded to float as they arrive, the precision the project
+// log stores them in, so the live stroke is drawn from exactly the values a replay reads
+// back. Strokes are aliased like the rest of the page, so fills still find crisp borders.
+class StrokeEngine {
+public:
+    // Points closer than this to the previous point, in page pixels, are dropped.
+    static constexpr double minimumSpacing = 0.25;
+
+    void begin(QImage* target, const QColor& color, double width, const QPointF& point, double pressure) {
+        end();
+        image = target;
+        brushWidth = std::max(1.0, width);
+        pen = QPen(color, brushWidth, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin);
+        strokePoints.assign(1, stored(point));
+        strokePressures.assign(1, static_cast<float>(pressure));
+        drawnPoints = 0;
+        strokeRect = QRect();
+        painter.begin(image);
+    }
+
+    bool isActive() const {
+        return painter.isActive();
+    }
+
+    void addPoint(const QPointF& point, double pressure) {
+        if (!isActive()) {
+            return;
+        }
+        QPointF next = stored(point);
+        QPointF step = next - strokePoints.back();
+        if (std::abs(step.x()) < minimumSpacing && std::abs(step.y()) < minimumSpacing) {
+            return;
+        }
+        strokePoints.push_back(next);
+        strokePressures.push_back(static_cast<float>(pressure));
+    }
+
+    // Draws the queued segments. Returns the page rectangle they touched.
+    QRect flush() {
+        if (!isActive()) {
+            return QRect();
+        }
+        QRect dirty;
+        for (; drawnPoints + 1 < strokePoints.size(); ++drawnPoints) {
+            size_t from = drawnPoints;
+            double width = segmentWidth(from, from + 1);
+            pen.setWidthF(width);
+            painter.setPen(pen);
+            painter.drawLine(QLineF(strokePoints[from], strokePoints[from + 1]));
+            dirty |= bounds(strokePoints[from], strokePoints[from + 1], width);
+        }
+        dirty &= image->rect();
+        strokeRect |= dirty;
+        return dirty;
+    }
+
+    // Flushes and releases the image. Returns the rectangle of the whole stroke, empty when
+    // the pen never moved: a click draws nothing, so double-click fills leave no marks.
+    QRect end() {
+        if (!isActive()) {
+            return QRect();
+        }
+        flush();
+        painter.end();
+        image = nullptr;
+        return strokeRect;
+    }
+
+    // The points the stroke was drawn through, after spacing, with their pressures.
+    const std::vector<QPointF>& points() const {
+        return strokePoints;
+    }
+
+    const std::vector<float>& pressures() const {
+        return strokePressures;
+    }
+
+private:
+    static QPointF stored(const QPointF& point) {
+        return QPointF(static_cast<float>(point.x()), static_cast<float>(point.y()));
+    }
+
+    double segmentWidth(size_t from, size_t to) const {
+        double pressure = 0.5 * (strokePressures[from] + strokePressures[to]);
+        return std::max(1.0, brushWidth * pressure);
+    }
+
+    static QRect bounds(const QPointF& a, const QPointF& b, double width) {
+        int margin = static_cast<int>(std::ceil(width / 2.0)) + 1;
+        return QRectF(a, b).normalized().toAlignedRect().adjusted(-margin, -margin, margin, margin);
+    }
+
+    QImage* image = nullptr;
+    QPainter painter;
+    QPen pen;
+    double brushWidth = 1.0;
+    std::vector<QPointF> strokePoints;
+    std::vector<float> strokePressures;
+    size_t drawnPoints = 0;
+    QRect strokeRect;
+};
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QMap>
+#include <QObject>
+#include <QString>
+#include <QtGlobal>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <functional>
+#include <utility>
+
+#ifdef Q_OS_WIN
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#elif defined(Q_OS_LINUX)
+#include <cstdio>
+#include <unistd.h>
+#endif
+
+// Latency distribution in fixed buckets that double in width from 50 us to about 7 minutes,
+// so it takes the same memory after a week as after a minute. Percentiles are the upper
+// bound of the bucket they fall in, capped at the largest sample.
+class LatencyHistogram {
+public:
+    static constexpr int bucketCount = 24;
+
+    static double bucketBound(int bucket) {
+        return 0.05 * std::ldexp(1.0, bucket);
+    }
+
+    void add(double milliseconds) {
+        int bucket = 0;
+        while (bucket < bucketCount - 1 && milliseconds > bucketBound(bucket)) {
+            ++bucket;
+        }
+        ++counts[bucket];
+        ++samples;
+        total += milliseconds;
+        largest = std::max(largest, milliseconds);
+    }
+
+    qint64 count() const {
+        return samples;
+    }
+
+    double percentile(double fraction) const {
+        const qint64 rank = static_cast<qint64>(std::ceil(fraction * samples));
+        qint64 seen = 0;
+        for (int bucket = 0; bucket < bucketCount; ++bucket) {
+            seen += counts[bucket];
+            if (seen >= rank && seen > 0) {
+                return std::min(bucketBound(bucket), largest);
+            }
+        }
+        return largest;
+    }
+
+    // Buckets are listed by upper bound in ms, "le" as in Prometheus; empty ones are left out.
+    QJsonObject toJson() const {
+        QJsonArray buckets;
+        for (int bucket = 0; bucket < bucketCount; ++bucket) {
+            if (counts[bucket] > 0) {
+                buckets.append(QJsonObject{ { "le", bucketBound(bucket) }, { "count", counts[bucket] } });
+            }
+        }
+        return QJsonObject{
+            { "count", samples },
+            { "mean", samples > 0 ? total / samples : 0.0 },
+            { "p50", percentile(0.5) },
+            { "p95", percentile(0.95) },
+            { "p99", percentile(0.99) },
+            { "max", largest },
+            { "buckets", buckets },
+        };
+    }
+
+private:
+    std::array<qint64, bucketCount> counts{};
+    qint64 samples = 0;
+    double total = 0.0;
+    double largest = 0.0;
+};
+
+// Session instrumentation for long-running installs: named latency histograms fed by the
+// window, and a JSON snapshot of them together with the memory figures the window supplies.
+// The snapshot is served on a QLocalServer, a named pipe on Windows and a Unix socket
+// elsewhere: every connection receives one compact JSON document and a newline, then the
+// server hangs up, so a monitoring agent only has to connect and read.
+//
+// Not thread-safe; record from the GUI thread.
+class Telemetry : public QObject {
+    Q_OBJECT
+
+public:
+    static constexpr const char* defaultServerName = "coloring-page-telemetry";
+    static constexpr int probeTimeoutMilliseconds = 200;
+
+    // Returns the extra fields of a snapshot, such as the window's memory use.
+    using Gauges = std::function<QJsonObject()>;
+
+    explicit Telemetry(QObject* parent = nullptr) : QObject(parent) {
+        uptime.start();
+        connect(&server, &QLocalServer::newConnection, this, &Telemetry::serveSnapshot);
+    }
+
+    void setGauges(Gauges gauges) {
+        collectGauges = std::move(gauges);
+    }
+
+    // Starts the endpoint. Returns false when the name stays taken by a live server.
+    bool listen(const QString& serverName = defaultServerName) {
+        if (server.listen(serverName)) {
+            return true;
+        }
+        // A crashed session leaves its socket file behind on Unix. Only a name nobody answers
+        // on is removed; a running instance keeps its endpoint.
+        QLocalSocket probe;
+        probe.connectToServer(serverName);
+        if (probe.waitForConnected(probeTimeoutMilliseconds)) {
+            probe.abort();
+            return false;
+        }
+        if (probe.error() != QLocalSocket::ServerNotFoundError && probe.error() != QLocalSocket::ConnectionRefusedError) {
+            return false;
+        }
+        QLocalServer::removeServer(serverName);
+        return server.listen(serverName);
+    }
+
+    QString serverName() const {
+        return server.isListening() ? server.fullServerName() : QString();
+    }
+
+    void record(const QString& name, double milliseconds) {
+        histograms[name].add(milliseconds);
+    }
+
+    const QMap<QString, LatencyHistogram>& latencies() const {
+        return histograms;
+    }
+
+    QJsonObject snapshot() const {
+        QJsonObject memory = collectGauges ? collectGauges() : QJsonObject();
+        ProcessMemory process = processMemory();
+        memory["process_working_set_bytes"] = process.workingSet;
+        memory["process_private_bytes"] = process.privateBytes;
+
+        QJsonObject latency;
+        for (auto entry = histograms.begin(); entry != histograms.end(); ++entry) {
+            latency[entry.key()] = entry.value().toJson();
+        }
+
+        return QJsonObject{
+            { "uptime_s", uptime.elapsed() / 1000.0 },
+            { "memory", memory },
+            { "latency_ms", latency },
+        };
+    }
+
+    struct ProcessMemory {
+        qint64 workingSet = 0;
+        qint64 privateBytes = 0;
+    };
+
+    // Resident and committed bytes of this process; zeros where the platform is not covered.
+    static ProcessMemory processMemory() {
+        ProcessMemory memory;
+#ifdef Q_OS_WIN
+        PROCESS_MEMORY_COUNTERS_EX counters = {};
+        if (GetProcessMemoryInfo(GetCurrentProcess(), reinterpret_cast<PROCESS_MEMORY_COUNTERS*>(&counters), sizeof(counters))) {
+            memory.workingSet = static_cast<qint64>(counters.WorkingSetSize);
+            memory.privateBytes = static_cast<qint64>(counters.PrivateUsage);
+        }
+#elif defined(Q_OS_LINUX)
+        // statm: total and resident pages, then shared; private is resident minus shared.
+        if (std::FILE* statm = std::fopen("/proc/self/statm", "r")) {
+            long long size = 0;
+            long long resident = 0;
+            long long shared = 0;
+            if (std::fscanf(statm, "%lld %lld %lld", &size, &resident, &shared) == 3) {
+                const qint64 pageSize = sysconf(_SC_PAGESIZE);
+                memory.workingSet = resident * pageSize;
+                memory.privateBytes = (resident - shared) * pageSize;
+            }
+            std::fclose(statm);
+        }
+#endif
+        return memory;
+    }
+
+private slots:
+    void serveSnapshot() {
+        while (QLocalSocket* socket = server.nextPendingConnection()) {
+            connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+            socket->write(QJsonDocument(snapshot()).toJson(QJsonDocument::Compact) + '\n');
+            socket->disconnectFromServer();
+        }
+    }
+
+private:
+    QElapsedTimer uptime;
+    QMap<QString, LatencyHistogram> histograms;
+    Gauges collectGauges;
+    QLocalServer server;
+};
@@ -0,0 +1,183 @@
+#pragma once
+
+#include "RegionIndex.h"
+
+#include <QColor>
+#include <QFile>
+#include <QMarginsF>
+#include <QPageSize>
+#include <QPainter>
+#include <QPainterPath>
+#include <QPdfWriter>
+#include <QPolygonF>
+#include <QString>
+#include <QTextStream>
+
+#include <opencv2/opencv.hpp>
+
+#include <algorithm>
+#include <vector>
+
+// Writes the page as resolution-independent shapes: one filled path per colored region of
+// the region index, then the line art on top. Outlines are traced from the current page, so
+// fills made since generation are included, and simplified with approxPolyDP. Each path is
+// also stroked one pixel wide in its own color: the traced outlines run through pixel
+// centers, and the stroke restores the pixel edges so one-pixel lines keep their width.
+//
+// Freehand strokes over a region are not traced; the region keeps the color of its first
+// pixel.
+class VectorExport {
+public:
+    static bool saveSvg(const QString& path, const cv::Mat& page, const RegionIndex& regions) {
+        QFile file(path);
+        if (page.empty() || !file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            return false;
+        }
+
+        QTextStream out(&file);
+        out.setRealNumberNotation(QTextStream::FixedNotation);
+        out.setRealNumberPrecision(1);
+
+        out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+            << "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"" << page.cols << "\" height=\"" << page.rows
+            << "\" viewBox=\"0 0 " << page.cols << ' ' << page.rows << "\">\n"
+            << "<rect width=\"" << page.cols << "\" height=\"" << page.rows << "\" fill=\"#ffffff\"/>\n"
+            << "<g fill-rule=\"evenodd\" stroke-width=\"1\" stroke-linejoin=\"round\" stroke-linecap=\"round\">\n";
+
+        traceShapes(page, regions, [&out](const cv::Vec3b& color, const std::vector<std::vector<cv::Point>>& polygons) {
+            QString hex = QString::asprintf("#%02x%02x%02x", color[2], color[1], color[0]);
+            out << "<path fill=\"" << hex << "\" stroke=\"" << hex << "\" d=\"";
+            for (const std::vector<cv::Point>& polygon : polygons) {
+                for (size_t i = 0; i < polygon.size(); ++i) {
+                    out << (i == 0 ? 'M' : 'L') << polygon[i].x + 0.5 << ' ' << polygon[i].y + 0.5;
+                }
+                out << 'Z';
+            }
+            out << "\"/>\n";
+        });
+
+        out << "</g>\n</svg>\n";
+        out.flush();
+        return out.status() == QTextStream::Ok && file.error() == QFileDevice::NoError;
+    }
+
+    // One page sized so that a page pixel prints at 1/dpi inch.
+    static bool savePdf(const QString& path, const cv::Mat& page, const RegionIndex& regions, int dpi = 300) {
+        if (page.empty()) {
+            return false;
+        }
+
+        QPdfWriter writer(path);
+        writer.setResolution(dpi);
+        writer.setPageSize(QPageSize(QSizeF(page.cols * 72.0 / dpi, page.rows * 72.0 / dpi), QPageSize::Point));
+        writer.setPageMargins(QMarginsF(0, 0, 0, 0));
+
+        // At the writer's resolution one device unit is one page pixel.
+        QPainter painter;
+        if (!painter.begin(&writer)) {
+            return false;
+        }
+        painter.setRenderHint(QPainter::Antialiasing);
+        painter.fillRect(QRectF(0, 0, page.cols, page.rows), Qt::white);
+
+        QPen pen;
+        pen.setWidthF(1.0);
+        pen.setJoinStyle(Qt::RoundJoin);
+        pen.setCapStyle(Qt::RoundCap);
+
+        traceShapes(page, regions, [&painter, &pen](const cv::Vec3b& color, const std::vector<std::vector<cv::Point>>& polygons) {
+            QPainterPath shape;
+            shape.setFillRule(Qt::OddEvenFill);
+            for (const std::vector<cv::Point>& polygon : polygons) {
+                QPolygonF outline;
+                outline.reserve(static_cast<int>(polygon.size()));
+                for (const cv::Point& point : polygon) {
+                    outline << QPointF(point.x + 0.5, point.y + 0.5);
+                }
+                shape.addPolygon(outline);
+                shape.closeSubpath();
+            }
+
+            QColor fill(color[2], color[1], color[0]);
+            pen.setColor(fill);
+            painter.fillPath(shape, fill);
+            painter.strokePath(shape, pen);
+        });
+
+        return painter.end();
+    }
+
+private:
+    // Calls emit(color, polygons) for every colored region, then for the colors painted on
+    // the gap barrier, and finally for the line art: dark pixels that belong to no region.
+    template <typename Emit>
+    static void traceShapes(const cv::Mat& page, const RegionIndex& regions, Emit emit) {
+        const cv::Vec3b paper(255, 255, 255);
+        const cv::Mat& labels = regions.labelImage();
+        std::vector<std::vector<cv::Point>> polygons;
+        cv::Mat mask;
+
+        for (int region = 1; region <= regions.regionCount(); ++region) {
+            const RegionIndex::Span* span = regions.spansBegin(region);
+            if (span == regions.spansEnd(region)) {
+                continue;
+            }
+            cv::Vec3b color = page.at<cv::Vec3b>(span->y, span->x0);
+            if (color == paper) {
+                continue;
+            }
+
+            cv::Rect bounds = regions.bounds(region);
+            cv::compare(labels(bounds), region, mask, cv::CMP_EQ);
+            trace(mask, bounds.tl(), polygons);
+            emit(color, polygons);
+        }
+
+        // Barrier pixels belong to no region, but a fill that did not close gaps paints them
+        // like the regions on either side; they are traced per color so the page has no seams.
+        const cv::Mat& barrier = regions.barrier();
+        cv::Rect barrierBounds = barrier.empty() ? cv::Rect() : cv::boundingRect(barrier);
+        if (!barrierBounds.empty()) {
+            std::vector<cv::Vec3b> barrierColors;
+            for (int y = barrierBounds.y; y < barrierBounds.br().y; ++y) {
+                const uchar* onBarrier = barrier.ptr<uchar>(y);
+                const cv::Vec3b* row = page.ptr<cv::Vec3b>(y);
+                for (int x = barrierBounds.x; x < barrierBounds.br().x; ++x) {
+                    if (onBarrier[x] && row[x] != paper && std::find(barrierColors.begin(), barrierColors.end(), row[x]) == barrierColors.end()) {
+                        barrierColors.push_back(row[x]);
+                    }
+                }
+            }
+
+            for (const cv::Vec3b& color : barrierColors) {
+                cv::Scalar value(color[0], color[1], color[2]);
+                cv::inRange(page(barrierBounds), value, value, mask);
+                cv::bitwise_and(mask, barrier(barrierBounds), mask);
+                trace(mask, barrierBounds.tl(), polygons);
+                emit(color, polygons);
+            }
+        }
+
+        cv::Mat grayscale;
+        cv::cvtColor(page, grayscale, cv::COLOR_BGR2GRAY);
+        cv::compare(grayscale, 128, mask, cv::CMP_LT);
+        if (!labels.empty()) {
+            cv::Mat unlabeled;
+            cv::compare(labels, 0, unlabeled, cv::CMP_EQ);
+            cv::bitwise_and(mask, unlabeled, mask);
+        }
+        trace(mask, cv::Point(0, 0), polygons);
+        if (!polygons.empty()) {
+            emit(cv::Vec3b(0, 0, 0), polygons);
+        }
+    }
+
+    // Outer outlines and holes, for even-odd filling.
+    static void trace(const cv::Mat& mask, const cv::Point& offset, std::vector<std::vector<cv::Point>>& polygons) {
+        polygons.clear();
+        cv::findContours(mask, polygons, cv::RETR_CCOMP, cv::CHAIN_APPROX_SIMPLE, offset);
+        for (std::vector<cv::Point>& polygon : polygons) {
+            cv::approxPolyDP(polygon, polygon, 0.7, true);
+        }
+    }
+};
@@ -0,0 +1,200 @@
+#pragma once
+
+#include "BatchProcessor.h"
+#include "EngineWorkerPool.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QObject>
+#include <QTimer>
+
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <vector>
+
+// Long-running counterpart of BatchProcessor: watches an inbox directory and converts every
+// new or replaced image into the outbox on a pool of warm engines that lives as long as the
+// service. A file is queued once its size and modification time have stayed the same for one
+// poll, so images still being copied in are not picked up half-written. Images whose page in
+// the outbox is newer than the source are skipped, which makes restarts cheap.
+//
+// Every completed image and, every metrics interval, the queue depth and latency
+// percentiles are printed to stdout.
+class WatchFolderService : public QObject {
+    Q_OBJECT
+
+public:
+    WatchFolderService(const QString& inboxDir, const QString& outboxDir, int jobs, const PipelineParams& params, int metricsIntervalSeconds = 10, QObject* parent = nullptr)
+        : QObject(parent), inboxDir(inboxDir), outboxDir(outboxDir), params(params), pool(jobs) {
+        pollTimer.setInterval(500);
+        connect(&pollTimer, &QTimer::timeout, this, &WatchFolderService::scan);
+        connect(&watcher, &QFileSystemWatcher::directoryChanged, this, &WatchFolderService::scan);
+
+        metricsTimer.setInterval(std::max(1, metricsIntervalSeconds) * 1000);
+        connect(&metricsTimer, &QTimer::timeout, this, &WatchFolderService::printMetrics);
+    }
+
+    // Returns false, after printing why, when the directories are unusable.
+    bool start() {
+        if (!QDir(inboxDir).exists()) {
+            std::fprintf(stderr, "Inbox directory does not exist: %s\n", qUtf8Printable(inboxDir));
+            return false;
+        }
+        if (!QDir().mkpath(outboxDir)) {
+            std::fprintf(stderr, "Failed to create outbox directory: %s\n", qUtf8Printable(outboxDir));
+            return false;
+        }
+        if (!watcher.addPath(inboxDir)) {
+            std::fprintf(stderr, "Failed to watch %s\n", qUtf8Printable(inboxDir));
+            return false;
+        }
+
+        // As in batch mode, parallelism is across images.
+        if (pool.workerCount() > 1) {
+            cv::setNumThreads(1);
+        }
+
+        clock.start();
+        metricsTimer.start();
+        std::printf("Watching %s -> %s with %d workers\n", qUtf8Printable(inboxDir), qUtf8Printable(outboxDir), pool.workerCount());
+        std::fflush(stdout);
+
+        scan();
+        return true;
+    }
+
+private slots:
+    void scan() {
+        QDir inbox(inboxDir);
+        QFileInfoList files = inbox.entryInfoList({ "*.png", "*.jpg", "*.jpeg" }, QDir::Files, QDir::Name);
+
+        QHash<QString, FileState> stillChanging;
+        for (const QFileInfo& file : files) {
+            QString path = file.absoluteFilePath();
+            FileState state{ file.size(), file.lastModified() };
+            if (queued.value(path) == state.modified || isUpToDate(file)) {
+                continue;
+            }
+
+            // Seen unchanged since the previous scan: the writer is done with it.
+            auto previous = pending.constFind(path);
+            if (previous != pending.constEnd() && previous->size == state.size && previous->modified == state.modified) {
+                enqueue(file);
+                queued.insert(path, state.modified);
+            }
+            else {
+                stillChanging.insert(path, state);
+            }
+        }
+        pending = stillChanging;
+
+        if (pending.isEmpty()) {
+            pollTimer.stop();
+        }
+        else if (!pollTimer.isActive()) {
+            pollTimer.start();
+        }
+    }
+
+    void printMetrics() {
+        if (completed == 0 && inFlight == 0) {
+            return;
+        }
+
+        std::vector<double> latencies(recentLatencies.begin(), recentLatencies.end());
+        std::sort(latencies.begin(), latencies.end());
+        auto percentile = [&latencies](double fraction) {
+            return latencies.empty() ? 0.0 : latencies[static_cast<size_t>(fraction * (latencies.size() - 1) + 0.5)];
+        };
+
+        double minutes = clock.elapsed() / 60000.0;
+        std::printf("[metrics] queue %d waiting, %d running (peak depth %d) | %d done, %d failed, %.1f images/min | latency ms p50 %.0f p95 %.0f max %.0f\n",
+            pool.queuedJobs(), pool.busyWorkers(), peakDepth, completed, failed, minutes > 0.0 ? completed / minutes : 0.0,
+            percentile(0.5), percentile(0.95), latencies.empty() ? 0.0 : latencies.back());
+        std::fflush(stdout);
+    }
+
+private:
+    struct FileState {
+        qint64 size = 0;
+        QDateTime modified;
+    };
+
+    bool isUpToDate(const QFileInfo& file) const {
+        QFileInfo page(QDir(outboxDir).filePath(file.fileName()));
+        return page.exists() && page.lastModified() >= file.lastModified();
+    }
+
+    void enqueue(const QFileInfo& file) {
+        QString sourcePath = file.absoluteFilePath();
+        QString targetPath = QDir(outboxDir).filePath(file.fileName());
+        PipelineParams jobParams = params;
+        qint64 enqueuedAt = clock.elapsed();
+
+        ++inFlight;
+        peakDepth = std::max(peakDepth, inFlight);
+
+        pool.submit([this, sourcePath, targetPath, jobParams, enqueuedAt](ColoringPageEngine& engine) {
+            auto timing = std::make_shared<BatchProcessor::ImageTiming>();
+            timing->name = QFileInfo(sourcePath).fileName();
+            engine.setParams(jobParams);
+            BatchProcessor::processImage(engine, sourcePath, targetPath, *timing);
+
+            QMetaObject::invokeMethod(this, [this, timing, enqueuedAt]() {
+                finish(*timing, enqueuedAt);
+            }, Qt::QueuedConnection);
+        });
+    }
+
+    // Service thread: bookkeeping of a job the pool has finished.
+    void finish(const BatchProcessor::ImageTiming& timing, qint64 enqueuedAt) {
+        --inFlight;
+        double latencyMs = static_cast<double>(clock.elapsed() - enqueuedAt);
+
+        if (timing.succeeded) {
+            ++completed;
+            recentLatencies.push_back(latencyMs);
+            if (recentLatencies.size() > latencyWindow) {
+                recentLatencies.pop_front();
+            }
+            std::printf("%-40s load %7.1f  gen %8.1f  save %7.1f  latency %8.0f ms  (%d queued)\n", qUtf8Printable(timing.name),
+                timing.loadMs, timing.generateMs, timing.saveMs, latencyMs, inFlight);
+        }
+        else {
+            ++failed;
+            std::printf("%-40s FAILED: %s\n", qUtf8Printable(timing.name), qUtf8Printable(timing.error));
+        }
+        std::fflush(stdout);
+    }
+
+    static constexpr size_t latencyWindow = 512;
+
+    QString inboxDir;
+    QString outboxDir;
+    PipelineParams params;
+
+    QFileSystemWatcher watcher;
+    QTimer pollTimer;
+    QTimer metricsTimer;
+    QElapsedTimer clock;
+
+    // Files waiting to settle, and the modification time each queued file had.
+    QHash<QString, FileState> pending;
+    QHash<QString, QDateTime> queued;
+
+    // Submitted and not finished yet, whether waiting or running.
+    int inFlight = 0;
+    int peakDepth = 0;
+    int completed = 0;
+    int failed = 0;
+    std::deque<double> recentLatencies;
+
+    // Last, so the workers are joined before anything they report to goes away.
+    EngineWorkerPool pool;
+};
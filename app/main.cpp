@@ -1,331 +1,1243 @@
-#include <QtWidgets>
-#include <opencv2/opencv.hpp>
-
-class ImageControlsWindow : public QWidget {
-    Q_OBJECT
-
-public:
-    ImageControlsWindow(QWidget* parent = nullptr) : QWidget(parent) {
-        setWindowTitle("Image Controls");
-
-        QLabel* colorLabel = new QLabel("Color:");
-        colorPicker = new QPushButton;
-        connect(colorPicker, &QPushButton::clicked, this, &ImageControlsWindow::pickColor);
-        fillColor = Qt::black;
-        colorPicker->setStyleSheet(QString("background-color: %1").arg(fillColor.name()));
-
-        QLabel* fillLabel = new QLabel("Fill:");
-        fillTool = new QCheckBox;
-        fillTool->setCheckState(Qt::Unchecked);
-
-        QVBoxLayout* mainLayout = new QVBoxLayout;
-        mainLayout->addWidget(colorLabel);
-        mainLayout->addWidget(colorPicker);
-        mainLayout->addWidget(fillLabel);
-        mainLayout->addWidget(fillTool);
-        mainLayout->addStretch();
-
-        setLayout(mainLayout);
-
-        QPushButton* undoButton = new QPushButton("Undo");
-        connect(undoButton, &QPushButton::clicked, this, &ImageControlsWindow::undoLastAction);
-        mainLayout->addWidget(undoButton);
-    }
-
-    void undoLastAction() {
-        emit undoAction();
-    }
-
-signals:
-    void colorPicked(const QColor& color);
-    void fillToggled(bool checked);
-    void undoAction();
-
-private slots:
-    void pickColor() {
-        QColorDialog colorDialog(fillColor, this);
-        fillColor = colorDialog.getColor();
-        colorPicker->setStyleSheet(QString("background-color: %1").arg(fillColor.name()));
-
-        emit colorPicked(fillColor);
-    }
-
-    void toggleFill(bool checked) {
-        emit fillToggled(checked);
-    }
-
-private:
-    QPushButton* colorPicker;
-    QColor fillColor;
-    QCheckBox* fillTool;
-};
-
-class ColoringPageGenerator : public QMainWindow {
-    Q_OBJECT
-
-public:
-    ColoringPageGenerator(QWidget* parent = nullptr) : QMainWindow(parent) {
-        setWindowTitle("Coloring Page Generator");
-
-        QLabel* label = new QLabel("Select an image:");
-        QPushButton* button = new QPushButton("Browse");
-        connect(button, &QPushButton::clicked, this, &ColoringPageGenerator::browseImage);
-
-        QHBoxLayout* layout = new QHBoxLayout;
-        layout->addWidget(label);
-        layout->addWidget(button);
-
-        QVBoxLayout* mainLayout = new QVBoxLayout;
-        mainLayout->addLayout(layout);
-
-        drawingArea = new QLabel;
-        drawingArea->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
-        drawingArea->setAlignment(Qt::AlignCenter);
-        drawingArea->setStyleSheet("QLabel { background-color : white; }");
-
-        mainLayout->addWidget(drawingArea);
-
-        QWidget* centralWidget = new QWidget(this);
-        centralWidget->setLayout(mainLayout);
-        setCentralWidget(centralWidget);
-
-        drawingImage = nullptr;
-        drawing = false;
-
-        imageControlsWindow = new ImageControlsWindow;
-        connect(imageControlsWindow, &ImageControlsWindow::colorPicked, this, &ColoringPageGenerator::setFillColor);
-        connect(imageControlsWindow, &ImageControlsWindow::fillToggled, this, &ColoringPageGenerator::toggleFillTool);
-        connect(imageControlsWindow, &ImageControlsWindow::undoAction, this, &ColoringPageGenerator::undoLastAction);
-
-        QPushButton* saveButton = new QPushButton("Save");
-        connect(saveButton, &QPushButton::clicked, this, &ColoringPageGenerator::saveImage);
-        mainLayout->addWidget(saveButton);
-        
-    }
-
-protected:
-
-    void mousePressEvent(QMouseEvent* event) override {
-        if (event->button() == Qt::LeftButton && drawingImage) {
-            drawing = true;
-            lastPoint = event->pos() - drawingArea->pos(); 
-        }
-    }
-
-    void mouseMoveEvent(QMouseEvent* event) override {
-        if (drawing && drawingImage) {
-            QPoint currentPoint = event->pos() - drawingArea->pos(); 
-            if (drawingArea->rect().contains(currentPoint)) {
-                QPainter painter(drawingImage);
-                painter.setPen(fillColor);
-                painter.drawLine(lastPoint, currentPoint);
-                lastPoint = currentPoint;
-                drawingArea->setPixmap(QPixmap::fromImage(*drawingImage));
-            }
-        }
-    }
-
-    void mouseReleaseEvent(QMouseEvent* event) override {
-        if (event->button() == Qt::LeftButton && drawingImage) {
-            drawing = false;
-        }
-    }
-
-    void mouseDoubleClickEvent(QMouseEvent* event) override {
-        if (drawingImage && fillToolEnabled) {
-            QPoint point = event->pos() - drawingArea->pos(); 
-            int x = point.x();
-            int y = point.y();
-
-            try {
-                cv::Mat mask = cv::Mat::zeros(coloringPage.rows + 2, coloringPage.cols + 2, CV_8U);
-                cv::floodFill(coloringPage, mask, cv::Point(x, y), cv::Scalar(fillColor.red(), fillColor.green(), fillColor.blue()));
-
-
-                drawingImage = new QImage(coloringPage.data, coloringPage.cols, coloringPage.rows, coloringPage.step, QImage::Format_RGB888);
-                drawingArea->setPixmap(QPixmap::fromImage(*drawingImage));
-                addToColoringPageHistory(coloringPage.clone());
-            }
-            catch (cv::Exception& e) {
-                QMessageBox::critical(this, "Error", QString("Failed to perform flood fill: %1").arg(e.what()));
-            }
-        }
-    }
-
-private slots:
-    void browseImage() {
-        QString imagePath = QFileDialog::getOpenFileName(this, "Select Image", "", "Images (*.png *.jpg *.jpeg)");
-        if (!imagePath.isEmpty()) {
-            generateColoringPage(imagePath);
-        }
-    }
-    void postProcessContours(std::vector<std::vector<cv::Point>>& contours, double minContourArea, int smoothingIterations, int thickness)
-    {
-        contours.erase(std::remove_if(contours.begin(), contours.end(), [minContourArea](const std::vector<cv::Point>& contour) {
-            return cv::contourArea(contour) < minContourArea;
-            }), contours.end());
-
-        for (std::vector<cv::Point>& contour : contours)
-        {
-           
-            cv::approxPolyDP(contour, contour, smoothingIterations, true);
-
-            cv::drawContours(coloringPage, std::vector<std::vector<cv::Point>>{contour}, 0, cv::Scalar(0, 0, 0), thickness, cv::LINE_AA);
-
-
-            cv::Mat kernelClosing = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(5, 5));
-            cv::morphologyEx(coloringPage, coloringPage, cv::MORPH_CLOSE, kernelClosing);
-
-            
-        }
-    }
-
-    void generateColoringPage(const QString& imagePath) {
-        cv::Mat image = cv::imread(imagePath.toStdString());
-
-        if (image.empty()) {
-            QMessageBox::critical(this, "Error", "Failed to load the image.");
-            return;
-        }
-
-        try {
-            
-            int maxWidth = drawingArea->width();
-            int maxHeight = drawingArea->height();
-            double aspectRatio = static_cast<double>(image.cols) / image.rows;
-            int newWidth = maxWidth;
-            int newHeight = static_cast<int>(newWidth / aspectRatio);
-
-            if (newHeight > maxHeight) {
-                newHeight = maxHeight;
-                newWidth = static_cast<int>(newHeight * aspectRatio);
-            }
-
-            cv::resize(image, image, cv::Size(newWidth, newHeight));
-
-            drawingArea->setFixedSize(newWidth, newHeight);
-
-            cv::resize(image, image, cv::Size(drawingArea->width(), drawingArea->height()));
-
-
-
-            cv::Mat grayscale;
-            cv::cvtColor(image, grayscale, cv::COLOR_BGR2GRAY);
-
-            cv::Mat binaryImage;
-            cv::adaptiveThreshold(grayscale, binaryImage, 255, cv::ADAPTIVE_THRESH_MEAN_C, cv::THRESH_BINARY_INV, 15, 10);
-
-            cv::Mat dilatedImage;
-            cv::Mat kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(30, 30));
-            cv::dilate(binaryImage, dilatedImage, kernel);
-
-            cv::Mat erodedImage;
-            cv::erode(dilatedImage, erodedImage, kernel);
-
-            coloringPage = erodedImage.clone();
-
-            std::vector<std::vector<cv::Point>> contours;
-            cv::findContours(coloringPage, contours, cv::RETR_TREE, cv::CHAIN_APPROX_SIMPLE);
-
-            postProcessContours(contours, 150.0, 30, 1000);
-
-            cv::Mat contourMask(coloringPage.size(), CV_8U, cv::Scalar(0));
-            for (const auto& contour : contours) {
-                cv::drawContours(contourMask, std::vector<std::vector<cv::Point>>{contour}, 0, cv::Scalar(255), cv::FILLED);
-            }
-
-            cv::Mat kernelClosing = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(5, 5));
-            cv::morphologyEx(contourMask, contourMask, cv::MORPH_CLOSE, kernelClosing);
-            cv::bitwise_and(coloringPage, contourMask, coloringPage);
-
-            coloringPage = cv::Mat(image.size(), CV_8UC3, cv::Scalar(255, 255, 255));
-            coloringPage.setTo(cv::Scalar(0, 0, 0), binaryImage);
-
-            double gapAreaThreshold = 50.0;
-            for (const auto& contour : contours) {
-                double contourArea = cv::contourArea(contour);
-                if (contourArea < gapAreaThreshold) {
-                    cv::Mat gapMask(coloringPage.size(), CV_8U, cv::Scalar(0));
-                    cv::drawContours(gapMask, std::vector<std::vector<cv::Point>>{contour}, 0, cv::Scalar(255), cv::FILLED);
-
-                    cv::inpaint(coloringPage, gapMask, coloringPage, 3, cv::INPAINT_TELEA);
-                }
-            }
-
-            addToColoringPageHistory(coloringPage.clone());
-
-            drawingImage = new QImage(coloringPage.data, coloringPage.cols, coloringPage.rows, coloringPage.step, QImage::Format_RGB888);
-            drawingArea->setFixedSize(image.cols, image.rows);
-
-            setMinimumSize(image.cols, image.rows);
-        }
-        catch (cv::Exception& e) {
-            QMessageBox::critical(this, "Error", QString("Failed to generate coloring page: %1").arg(e.what()));
-        }
-    }
-
-    void saveImage() {
-        QString savePath = QFileDialog::getSaveFileName(this, "Save Image", "", "Images (*.png *.jpg *.jpeg)");
-        if (!savePath.isEmpty()) {
-            if (drawingImage && drawingImage->save(savePath)) {
-                QMessageBox::information(this, "Success", "Image saved successfully.");
-            }
-            else {
-                QMessageBox::critical(this, "Error", "Failed to save the image.");
-            }
-        }
-    }
-   
-
-public:
-    void setFillColor(const QColor& color) {
-        fillColor = color;
-    }
-
-    void toggleFillTool(bool checked) {
-        fillToolEnabled = checked;
-    }
-
-    void undoLastAction() {
-        if (coloringPageHistory.size() > 1) {
-            coloringPageHistory.pop_back();
-            coloringPage = coloringPageHistory.back().clone();
-            drawingImage = new QImage(coloringPage.data, coloringPage.cols, coloringPage.rows, coloringPage.step, QImage::Format_RGB888);
-            drawingArea->setPixmap(QPixmap::fromImage(*drawingImage));
-        }
-    }
-
-private:
-    QLabel* drawingArea;
-    QImage* drawingImage;
-    bool drawing;
-    QPoint lastPoint;
-    cv::Mat coloringPage;
-    std::vector<cv::Mat> coloringPageHistory;
-    ImageControlsWindow* imageControlsWindow;
-    QColor fillColor;
-    bool fillToolEnabled;
-
-    void addToColoringPageHistory(const cv::Mat& page) {
-        coloringPageHistory.push_back(page.clone());
-    }
-};
-
-int main(int argc, char** argv) {
-    QApplication app(argc, argv);
-
-    ColoringPageGenerator generator;
-    generator.showMaximized();
-
-    ImageControlsWindow imageControlsWindow;
-    imageControlsWindow.show();
-
-    QObject::connect(&imageControlsWindow, &ImageControlsWindow::colorPicked, &generator, &ColoringPageGenerator::setFillColor);
-    QObject::connect(&imageControlsWindow, &ImageControlsWindow::fillToggled, &generator, &ColoringPageGenerator::toggleFillTool);
-    QObject::connect(&imageControlsWindow, &ImageControlsWindow::undoAction, &generator, &ColoringPageGenerator::undoLastAction);
-
-    return app.exec();
-}
-
-#include "main.moc"
-
+#include <QtWidgets>
+#include <opencv2/opencv.hpp>
+
+#include "BatchProcessor.h"
+#include "BookExport.h"
+#include "ColoringPageEngine.h"
+#include "DrawingCanvas.h"
+#include "FillEngine.h"
+#include "LivePreview.h"
+#include "MatImage.h"
+#include "PageGenerationTask.h"
+#include "PageHistory.h"
+#include "ProjectFile.h"
+#include "RegionIndex.h"
+#include "StrokeEngine.h"
+#include "Telemetry.h"
+#include "VectorExport.h"
+#include "WatchFolderService.h"
+
+#ifdef Q_OS_WIN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+#include <cstdio>
+#include <cstring>
+
+Q_LOGGING_CATEGORY(profileLog, "coloring.profile")
+
+class ImageControlsWindow : public QWidget {
+    Q_OBJECT
+
+public:
+    ImageControlsWindow(QWidget* parent = nullptr) : QWidget(parent) {
+        setWindowTitle("Image Controls");
+
+        QLabel* colorLabel = new QLabel("Color:");
+        colorPicker = new QPushButton;
+        connect(colorPicker, &QPushButton::clicked, this, &ImageControlsWindow::pickColor);
+        fillColor = Qt::black;
+        colorPicker->setStyleSheet(QString("background-color: %1").arg(fillColor.name()));
+
+        QLabel* brushLabel = new QLabel("Brush size:");
+        QSpinBox* brushSize = new QSpinBox;
+        brushSize->setRange(1, 64);
+        brushSize->setSuffix(" px");
+        brushSize->setToolTip("Stroke width at full pen pressure; the mouse always draws at full pressure.");
+        connect(brushSize, &QSpinBox::valueChanged, this, &ImageControlsWindow::brushSizeChanged);
+
+        QLabel* fillLabel = new QLabel("Fill:");
+        fillTool = new QCheckBox;
+        fillTool->setCheckState(Qt::Unchecked);
+        fillTool->setToolTip("Double-click fills a region, Shift+double-click fills every region of that color.");
+        connect(fillTool, &QCheckBox::toggled, this, &ImageControlsWindow::toggleFill);
+
+        QCheckBox* closeGaps = new QCheckBox("Close gaps");
+        closeGaps->setChecked(true);
+        closeGaps->setToolTip("Fills stop at small breaks in the lines as if they were closed. The lines on the page stay as they are.");
+        connect(closeGaps, &QCheckBox::toggled, this, &ImageControlsWindow::closeGapsToggled);
+
+        QVBoxLayout* mainLayout = new QVBoxLayout;
+        mainLayout->addWidget(colorLabel);
+        mainLayout->addWidget(colorPicker);
+        mainLayout->addWidget(brushLabel);
+        mainLayout->addWidget(brushSize);
+        mainLayout->addWidget(fillLabel);
+        mainLayout->addWidget(fillTool);
+        mainLayout->addWidget(closeGaps);
+
+        QGroupBox* pipelineBox = new QGroupBox("Line art");
+        QFormLayout* pipelineLayout = new QFormLayout;
+        QComboBox* processingSize = new QComboBox;
+        processingSize->addItem("Full resolution", 0);
+        for (int longEdge : { 4096, 2048, 1024 }) {
+            processingSize->addItem(QString("%1 px").arg(longEdge), longEdge);
+        }
+        processingSize->setToolTip("Longest edge the page is generated at. Zooming the view never regenerates.");
+        connect(processingSize, &QComboBox::currentIndexChanged, this, [this, processingSize](int index) {
+            emit processingSizeChanged(processingSize->itemData(index).toInt());
+        });
+        pipelineLayout->addRow("Processing size", processingSize);
+        QCheckBox* fusedThreshold = new QCheckBox;
+        fusedThreshold->setChecked(pipelineParams.fusedThreshold);
+        fusedThreshold->setToolTip("Grayscale and threshold in one pass instead of OpenCV's cvtColor + adaptiveThreshold.");
+        connect(fusedThreshold, &QCheckBox::toggled, this, [this](bool checked) {
+            pipelineParams.fusedThreshold = checked;
+            emit pipelineParamsChanged(pipelineParams);
+        });
+        pipelineLayout->addRow("Fused threshold", fusedThreshold);
+        QCheckBox* useOpenCL = new QCheckBox;
+        useOpenCL->setChecked(pipelineParams.useOpenCL);
+        useOpenCL->setToolTip("Run resize, threshold and closing on the GPU through OpenCL. Falls back to the CPU without a device.");
+        connect(useOpenCL, &QCheckBox::toggled, this, [this](bool checked) {
+            pipelineParams.useOpenCL = checked;
+            emit pipelineParamsChanged(pipelineParams);
+        });
+        pipelineLayout->addRow("OpenCL", useOpenCL);
+        QComboBox* edgeMethod = new QComboBox;
+        edgeMethod->addItem("Adaptive threshold", static_cast<int>(EdgeMethod::AdaptiveThreshold));
+        edgeMethod->addItem("Pyramid Canny", static_cast<int>(EdgeMethod::PyramidCanny));
+        edgeMethod->addItem("XDoG", static_cast<int>(EdgeMethod::XDoG));
+        edgeMethod->addItem("Line-art model...", static_cast<int>(EdgeMethod::LineArtModel));
+        edgeMethod->setToolTip("How lines are found in the photo. The profile log shows what each one costs.");
+        connect(edgeMethod, &QComboBox::activated, this, [this, edgeMethod](int index) {
+            EdgeMethod method = static_cast<EdgeMethod>(edgeMethod->itemData(index).toInt());
+            if (method == EdgeMethod::LineArtModel) {
+                QString model = QFileDialog::getOpenFileName(this, "Line-art model", QString(), "Models (*.onnx *.pb *.caffemodel *.xml);;All files (*)");
+                if (model.isEmpty()) {
+                    edgeMethod->setCurrentIndex(edgeMethod->findData(static_cast<int>(pipelineParams.edgeMethod)));
+                    return;
+                }
+                pipelineParams.lineArtModel = model.toStdString();
+            }
+            pipelineParams.edgeMethod = method;
+            emit pipelineParamsChanged(pipelineParams);
+        });
+        pipelineLayout->addRow("Edges", edgeMethod);
+        addParameterSlider(pipelineLayout, "Threshold block", 1, 25, (pipelineParams.thresholdBlockSize - 1) / 2, [this](int value) {
+            pipelineParams.thresholdBlockSize = 2 * value + 1;
+            return QString::number(pipelineParams.thresholdBlockSize);
+        });
+        addParameterSlider(pipelineLayout, "Threshold offset", 0, 50, static_cast<int>(pipelineParams.thresholdC), [this](int value) {
+            pipelineParams.thresholdC = value;
+            return QString::number(value);
+        });
+        addParameterSlider(pipelineLayout, "Closing kernel", 1, 60, pipelineParams.closingKernelSize, [this](int value) {
+            pipelineParams.closingKernelSize = value;
+            return QString::number(value);
+        });
+        addParameterSlider(pipelineLayout, "Min contour area", 0, 2000, static_cast<int>(pipelineParams.minContourArea), [this](int value) {
+            pipelineParams.minContourArea = value;
+            return QString::number(value);
+        });
+        addParameterSlider(pipelineLayout, "Contour epsilon", 1, 100, static_cast<int>(pipelineParams.contourEpsilon), [this](int value) {
+            pipelineParams.contourEpsilon = value;
+            return QString::number(value);
+        });
+        addParameterSlider(pipelineLayout, "Mask closing", 1, 15, pipelineParams.maskClosingSize, [this](int value) {
+            pipelineParams.maskClosingSize = value;
+            return QString::number(value);
+        });
+        addParameterSlider(pipelineLayout, "Gap area", 0, 500, static_cast<int>(pipelineParams.gapAreaThreshold), [this](int value) {
+            pipelineParams.gapAreaThreshold = value;
+            return QString::number(value);
+        });
+        pipelineBox->setLayout(pipelineLayout);
+        mainLayout->addWidget(pipelineBox);
+
+        mainLayout->addStretch();
+
+        setLayout(mainLayout);
+
+        QPushButton* undoButton = new QPushButton("Undo");
+        connect(undoButton, &QPushButton::clicked, this, &ImageControlsWindow::undoLastAction);
+        mainLayout->addWidget(undoButton);
+
+        QPushButton* redoButton = new QPushButton("Redo");
+        connect(redoButton, &QPushButton::clicked, this, &ImageControlsWindow::redoLastAction);
+        mainLayout->addWidget(redoButton);
+    }
+
+    void undoLastAction() {
+        emit undoAction();
+    }
+
+    void redoLastAction() {
+        emit redoAction();
+    }
+
+signals:
+    void colorPicked(const QColor& color);
+    void brushSizeChanged(int width);
+    void fillToggled(bool checked);
+    void closeGapsToggled(bool checked);
+    void undoAction();
+    void redoAction();
+    void pipelineParamsChanged(const PipelineParams& params);
+    void processingSizeChanged(int longEdge);
+
+private slots:
+    void pickColor() {
+        QColorDialog colorDialog(fillColor, this);
+        fillColor = colorDialog.getColor();
+        colorPicker->setStyleSheet(QString("background-color: %1").arg(fillColor.name()));
+
+        emit colorPicked(fillColor);
+    }
+
+    void toggleFill(bool checked) {
+        emit fillToggled(checked);
+    }
+
+private:
+    // Adds a slider row; apply stores the slider value into pipelineParams and returns the
+    // text shown next to it.
+    void addParameterSlider(QFormLayout* layout, const QString& name, int minimum, int maximum, int value, std::function<QString(int)> apply) {
+        QSlider* slider = new QSlider(Qt::Horizontal);
+        slider->setRange(minimum, maximum);
+        slider->setValue(value);
+
+        QLabel* valueLabel = new QLabel(apply(value));
+        valueLabel->setMinimumWidth(valueLabel->fontMetrics().horizontalAdvance("0000"));
+
+        connect(slider, &QSlider::valueChanged, this, [this, valueLabel, apply](int newValue) {
+            valueLabel->setText(apply(newValue));
+            emit pipelineParamsChanged(pipelineParams);
+        });
+
+        QHBoxLayout* row = new QHBoxLayout;
+        row->addWidget(slider);
+        row->addWidget(valueLabel);
+        layout->addRow(name, row);
+    }
+
+    QPushButton* colorPicker;
+    QColor fillColor;
+    QCheckBox* fillTool;
+    PipelineParams pipelineParams;
+};
+
+// Shows the camera converted live at up to 30 fps in 720p. Freeze hands the frame on screen
+// to the full pipeline of the main window. The camera runs only while the window is shown.
+class LivePreviewWindow : public QWidget {
+    Q_OBJECT
+
+public:
+    LivePreviewWindow(QWidget* parent = nullptr) : QWidget(parent) {
+        setWindowTitle("Live Preview");
+
+        view = new QLabel;
+        view->setAlignment(Qt::AlignCenter);
+        view->setMinimumSize(640, 360);
+        view->setSizePolicy(QSizePolicy::Ignored, QSizePolicy::Ignored);
+
+        statsLabel = new QLabel;
+        QPushButton* freezeButton = new QPushButton("Freeze");
+        freezeButton->setToolTip("Generate a full-quality page from the current frame.");
+        connect(freezeButton, &QPushButton::clicked, this, &LivePreviewWindow::freeze);
+
+        QHBoxLayout* controls = new QHBoxLayout;
+        controls->addWidget(statsLabel);
+        controls->addStretch();
+        controls->addWidget(freezeButton);
+
+        QVBoxLayout* layout = new QVBoxLayout(this);
+        layout->addWidget(view);
+        layout->addLayout(controls);
+
+        connect(&preview, &LivePreview::opened, statsLabel, &QLabel::clear);
+        connect(&preview, &LivePreview::pageReady, this, &LivePreviewWindow::showPage);
+        connect(&preview, &LivePreview::statsUpdated, this, &LivePreviewWindow::showStats);
+        connect(&preview, &LivePreview::failed, this, &LivePreviewWindow::showError);
+    }
+
+    void setParams(const PipelineParams& params) {
+        preview.setParams(params);
+    }
+
+signals:
+    void frozen(const cv::Mat& frame);
+
+protected:
+    void showEvent(QShowEvent* event) override {
+        QWidget::showEvent(event);
+        if (!preview.isRunning()) {
+            statsLabel->setText("Opening the camera...");
+            preview.start(0);
+        }
+    }
+
+    void hideEvent(QHideEvent* event) override {
+        preview.stop();
+        QWidget::hideEvent(event);
+    }
+
+private slots:
+    void showPage() {
+        preview.withFrontPage([this](const cv::Mat& page) {
+            view->setPixmap(QPixmap::fromImage(MatImage::wrap(page)).scaled(view->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
+        });
+    }
+
+    void showStats(double pagesPerSecond, double convertMilliseconds, int droppedFrames) {
+        statsLabel->setText(QString("%1 fps, %2 ms per frame, %3 frames dropped")
+            .arg(pagesPerSecond, 0, 'f', 1).arg(convertMilliseconds, 0, 'f', 1).arg(droppedFrames));
+    }
+
+    void showError(const QString& message) {
+        preview.stop();
+        statsLabel->setText(message);
+    }
+
+    void freeze() {
+        cv::Mat frame = preview.currentFrame();
+        if (!frame.empty()) {
+            emit frozen(frame);
+        }
+    }
+
+private:
+    QLabel* view;
+    QLabel* statsLabel;
+    LivePreview preview;
+};
+
+// The telemetry snapshot as a table, refreshed every second while the window is shown. It
+// renders the same snapshot the local socket serves.
+class TelemetryWindow : public QWidget {
+    Q_OBJECT
+
+public:
+    TelemetryWindow(const Telemetry& telemetry, QWidget* parent = nullptr) : QWidget(parent), telemetry(telemetry) {
+        setWindowTitle("Telemetry");
+
+        report = new QPlainTextEdit;
+        report->setReadOnly(true);
+        report->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+        report->setMinimumSize(640, 420);
+
+        QVBoxLayout* layout = new QVBoxLayout(this);
+        layout->addWidget(report);
+
+        refreshTimer.setInterval(1000);
+        connect(&refreshTimer, &QTimer::timeout, this, &TelemetryWindow::showSnapshot);
+    }
+
+protected:
+    void showEvent(QShowEvent* event) override {
+        QWidget::showEvent(event);
+        showSnapshot();
+        refreshTimer.start();
+    }
+
+    void hideEvent(QHideEvent* event) override {
+        refreshTimer.stop();
+        QWidget::hideEvent(event);
+    }
+
+private slots:
+    void showSnapshot() {
+        QJsonObject snapshot = telemetry.snapshot();
+        QString endpoint = telemetry.serverName();
+        QString text = QString("Endpoint   %1\nUptime     %2 s\n\nMemory\n")
+            .arg(endpoint.isEmpty() ? "not listening" : endpoint)
+            .arg(snapshot["uptime_s"].toDouble(), 0, 'f', 0);
+
+        QJsonObject memory = snapshot["memory"].toObject();
+        for (auto entry = memory.begin(); entry != memory.end(); ++entry) {
+            double value = entry.value().toDouble();
+            QString shown = entry.key().endsWith("_bytes") ? QString("%1 MB").arg(value / (1024.0 * 1024.0), 0, 'f', 1) : QString::number(value);
+            text += QString("  %1 %2\n").arg(entry.key(), -32).arg(shown, 12);
+        }
+
+        text += QString("\nLatency ms %1 %2 %3 %4 %5 %6\n").arg("", -21).arg("count", 8).arg("p50", 9).arg("p95", 9).arg("p99", 9).arg("max", 9);
+        QJsonObject latency = snapshot["latency_ms"].toObject();
+        for (auto entry = latency.begin(); entry != latency.end(); ++entry) {
+            QJsonObject histogram = entry.value().toObject();
+            text += QString("  %1 %2 %3 %4 %5 %6\n").arg(entry.key(), -30)
+                .arg(histogram["count"].toInteger(), 8)
+                .arg(histogram["p50"].toDouble(), 9, 'f', 2).arg(histogram["p95"].toDouble(), 9, 'f', 2)
+                .arg(histogram["p99"].toDouble(), 9, 'f', 2).arg(histogram["max"].toDouble(), 9, 'f', 2);
+        }
+        report->setPlainText(text);
+    }
+
+private:
+    const Telemetry& telemetry;
+    QPlainTextEdit* report;
+    QTimer refreshTimer;
+};
+
+class ColoringPageGenerator : public QMainWindow {
+    Q_OBJECT
+
+public:
+    ColoringPageGenerator(QWidget* parent = nullptr) : QMainWindow(parent) {
+        setWindowTitle("Coloring Page Generator");
+
+        QLabel* label = new QLabel("Select an image:");
+        QPushButton* button = new QPushButton("Browse");
+        connect(button, &QPushButton::clicked, this, &ColoringPageGenerator::browseImage);
+
+        QPushButton* cameraButton = new QPushButton("Camera");
+        cameraButton->setToolTip("Preview the camera as a coloring page live.");
+
+        QPushButton* telemetryButton = new QPushButton("Telemetry");
+        telemetryButton->setToolTip("Memory use and latency of this session.");
+
+        QPushButton* fitButton = new QPushButton("Fit");
+        fitButton->setToolTip("Show the whole page. Wheel zooms, middle button pans.");
+
+        QHBoxLayout* layout = new QHBoxLayout;
+        layout->addWidget(label);
+        layout->addWidget(button);
+        layout->addWidget(cameraButton);
+        layout->addWidget(telemetryButton);
+        layout->addStretch();
+        layout->addWidget(fitButton);
+
+        QVBoxLayout* mainLayout = new QVBoxLayout;
+        mainLayout->addLayout(layout);
+
+        drawingArea = new DrawingCanvas;
+
+        connect(drawingArea, &DrawingCanvas::hoverMoved, this, &ColoringPageGenerator::highlightRegionAt);
+        connect(drawingArea, &DrawingCanvas::hoverLeft, this, &ColoringPageGenerator::clearRegionHighlight);
+        connect(drawingArea, &DrawingCanvas::zoomChanged, this, &ColoringPageGenerator::showZoom);
+        connect(fitButton, &QPushButton::clicked, drawingArea, &DrawingCanvas::fitToWindow);
+
+        mainLayout->addWidget(drawingArea);
+
+        QWidget* centralWidget = new QWidget(this);
+        centralWidget->setLayout(mainLayout);
+        setCentralWidget(centralWidget);
+
+        fillToolEnabled = false;
+
+        livePreviewWindow = new LivePreviewWindow(this);
+        livePreviewWindow->setWindowFlag(Qt::Window);
+        connect(cameraButton, &QPushButton::clicked, livePreviewWindow, &QWidget::show);
+        connect(livePreviewWindow, &LivePreviewWindow::frozen, this, &ColoringPageGenerator::generateFromFrame);
+
+        telemetry.setGauges([this]() {
+            return QJsonObject{
+                { "history_bytes", static_cast<qint64>(history.memoryUsage()) },
+                { "history_budget_bytes", static_cast<qint64>(history.memoryBudget()) },
+                { "page_bytes", static_cast<qint64>(coloringPage.total() * coloringPage.elemSize()) },
+                { "canvas_images", drawingArea->levelCount() + (drawingImage.isNull() ? 0 : 1) },
+                { "canvas_image_bytes", drawingArea->levelBytes() },
+            };
+        });
+        if (!telemetry.listen()) {
+            qWarning("Telemetry endpoint %s is taken; serving the panel only", Telemetry::defaultServerName);
+        }
+        TelemetryWindow* telemetryWindow = new TelemetryWindow(telemetry, this);
+        telemetryWindow->setWindowFlag(Qt::Window);
+        connect(telemetryButton, &QPushButton::clicked, telemetryWindow, &QWidget::show);
+
+        imageControlsWindow = new ImageControlsWindow;
+        connect(imageControlsWindow, &ImageControlsWindow::colorPicked, this, &ColoringPageGenerator::setFillColor);
+        connect(imageControlsWindow, &ImageControlsWindow::brushSizeChanged, this, &ColoringPageGenerator::setBrushSize);
+        connect(imageControlsWindow, &ImageControlsWindow::fillToggled, this, &ColoringPageGenerator::toggleFillTool);
+        connect(imageControlsWindow, &ImageControlsWindow::closeGapsToggled, this, &ColoringPageGenerator::setCloseGaps);
+        connect(imageControlsWindow, &ImageControlsWindow::undoAction, this, &ColoringPageGenerator::undoLastAction);
+        connect(imageControlsWindow, &ImageControlsWindow::redoAction, this, &ColoringPageGenerator::redoLastAction);
+        connect(imageControlsWindow, &ImageControlsWindow::pipelineParamsChanged, this, &ColoringPageGenerator::setPipelineParams);
+        connect(imageControlsWindow, &ImageControlsWindow::processingSizeChanged, this, &ColoringPageGenerator::setProcessingSize);
+
+        QPushButton* saveButton = new QPushButton("Save");
+        connect(saveButton, &QPushButton::clicked, this, &ColoringPageGenerator::saveImage);
+        mainLayout->addWidget(saveButton);
+
+        exportBookButton = new QPushButton("Export Book");
+        exportBookButton->setToolTip("Lay saved pages out for print as one PDF, or as PNG sheets.");
+        connect(exportBookButton, &QPushButton::clicked, this, &ColoringPageGenerator::exportBook);
+        mainLayout->addWidget(exportBookButton);
+
+        zoomLabel = new QLabel;
+        statusBar()->addPermanentWidget(zoomLabel);
+
+        generationProgress = new QProgressBar;
+        generationProgress->setRange(0, ColoringPageEngine::stageCount);
+        generationProgress->setVisible(false);
+        statusBar()->addPermanentWidget(generationProgress);
+
+        cancelGenerationButton = new QPushButton("Cancel");
+        cancelGenerationButton->setVisible(false);
+        connect(cancelGenerationButton, &QPushButton::clicked, &generationTask, &PageGenerationTask::cancel);
+        statusBar()->addPermanentWidget(cancelGenerationButton);
+
+        connect(&generationTask, &PageGenerationTask::stageStarted, this, &ColoringPageGenerator::showGenerationStage);
+        connect(&generationTask, &PageGenerationTask::finished, this, &ColoringPageGenerator::showGeneratedPage);
+        connect(&generationTask, &PageGenerationTask::failed, this, &ColoringPageGenerator::showGenerationError);
+        connect(&generationTask, &PageGenerationTask::canceled, this, &ColoringPageGenerator::hideGenerationProgress);
+
+        // Edits are logged as they happen and written out in one small append per second.
+        autosaveTimer.setInterval(1000);
+        connect(&autosaveTimer, &QTimer::timeout, this, [this]() {
+            project.flush();
+        });
+        autosaveTimer.start();
+
+        // Stroke input is rasterized once per frame, whatever the pen's report rate.
+        strokeTimer.setInterval(16);
+        connect(&strokeTimer, &QTimer::timeout, this, &ColoringPageGenerator::flushStroke);
+
+        QTimer::singleShot(0, this, &ColoringPageGenerator::offerSessionRestore);
+    }
+
+protected:
+
+    void mousePressEvent(QMouseEvent* event) override {
+        if (event->button() == Qt::LeftButton && !drawingImage.isNull()) {
+            beginStroke(pagePoint(event->position()), 1.0);
+        }
+    }
+
+    void mouseMoveEvent(QMouseEvent* event) override {
+        if (strokes.isActive()) {
+            strokes.addPoint(pagePoint(event->position()), 1.0);
+        }
+    }
+
+    void mouseReleaseEvent(QMouseEvent* event) override {
+        if (event->button() == Qt::LeftButton) {
+            endStroke();
+        }
+    }
+
+    // Pen input arrives here from the canvas. Accepting it keeps Qt from also synthesizing
+    // mouse events for the same pen.
+    void tabletEvent(QTabletEvent* event) override {
+        if (drawingImage.isNull()) {
+            event->ignore();
+            return;
+        }
+        QPointF point = pagePoint(event->position());
+        switch (event->type()) {
+        case QEvent::TabletPress:
+            if (event->button() == Qt::LeftButton) {
+                beginStroke(point, event->pressure());
+            }
+            break;
+        case QEvent::TabletMove:
+            if (strokes.isActive()) {
+                strokes.addPoint(point, event->pressure());
+            }
+            break;
+        case QEvent::TabletRelease:
+            if (event->button() == Qt::LeftButton) {
+                endStroke();
+            }
+            break;
+        default:
+            event->ignore();
+            return;
+        }
+        event->accept();
+    }
+
+    void mouseDoubleClickEvent(QMouseEvent* event) override {
+        if (!drawingImage.isNull() && fillToolEnabled) {
+            QPoint point = pagePoint(event->position().toPoint());
+            bool allOfColor = event->modifiers() & Qt::ShiftModifier;
+
+            try {
+                double fillMilliseconds = 0.0;
+                cv::Rect filledRect;
+                {
+                    ScopedTimer timer(fillMilliseconds);
+                    filledRect = applyFill(point, fillColor, allOfColor, closeGaps);
+                    if (!filledRect.empty()) {
+                        drawingArea->refresh(QRect(filledRect.x, filledRect.y, filledRect.width, filledRect.height));
+                        history.commit(coloringPage, filledRect);
+                    }
+                }
+                if (filledRect.empty()) {
+                    return;
+                }
+                telemetry.record(allOfColor ? "fill_all_of_color" : "fill", fillMilliseconds);
+                project.append(PageOperation{ allOfColor ? PageOperation::FillAllOfColor : PageOperation::Fill, fillColor.rgba(), 1.0f, { QPointF(point) }, {}, closeGaps });
+            }
+            catch (cv::Exception& e) {
+                QMessageBox::critical(this, "Error", QString("Failed to perform flood fill: %1").arg(e.what()));
+            }
+        }
+    }
+
+private slots:
+    void browseImage() {
+        QString imagePath = QFileDialog::getOpenFileName(this, "Select Image", "", "Images (*.png *.jpg *.jpeg);;Coloring projects (*.cpproj)");
+        if (imagePath.endsWith(".cpproj", Qt::CaseInsensitive)) {
+            openProject(imagePath);
+        }
+        else if (!imagePath.isEmpty()) {
+            generateColoringPage(imagePath);
+        }
+    }
+
+    // Offers to bring back the page and edits of the last session, e.g. after a crash.
+    void offerSessionRestore() {
+        ProjectFile::Contents contents;
+        if (!ProjectFile::read(sessionPath(), contents)) {
+            return;
+        }
+        if (QMessageBox::question(this, "Restore Session", "Restore the page you were coloring last time?") != QMessageBox::Yes) {
+            return;
+        }
+        restoreProject(contents);
+        if (contents.currentFormat) {
+            project.resume(sessionPath(), contents.validSize);
+        }
+        else {
+            rewriteSession(contents);
+        }
+    }
+
+    // A saved project continues in the session file, so the original stays as it was saved.
+    void openProject(const QString& path) {
+        ProjectFile::Contents contents;
+        if (!ProjectFile::read(path, contents)) {
+            QMessageBox::critical(this, "Error", "Failed to open the project.");
+            return;
+        }
+        restoreProject(contents);
+        rewriteSession(contents);
+    }
+
+    void rewriteSession(const ProjectFile::Contents& contents) {
+        project.create(sessionPath(), contents.lineArt);
+        for (const PageOperation& operation : contents.operations) {
+            project.append(operation);
+        }
+        project.flush();
+    }
+
+    void generateColoringPage(const QString& imagePath) {
+        currentImagePath = imagePath;
+        frozenFrame.release();
+        generationTask.start(imagePath, cv::Size(processingSize, processingSize));
+        showGenerationStarted();
+    }
+
+    void generateFromFrame(const cv::Mat& frame) {
+        currentImagePath.clear();
+        frozenFrame = frame;
+        generationTask.startFromImage(frame, cv::Size(processingSize, processingSize));
+        showGenerationStarted();
+    }
+
+    void showGenerationStarted() {
+        statusBar()->showMessage("Generating coloring page...");
+        generationProgress->setValue(0);
+        generationProgress->setVisible(true);
+        cancelGenerationButton->setVisible(true);
+    }
+
+    void showGenerationStage(int stage, int stageCount, const QString& name) {
+        generationProgress->setMaximum(stageCount);
+        generationProgress->setValue(stage);
+        generationProgress->setVisible(true);
+        cancelGenerationButton->setVisible(true);
+        statusBar()->showMessage(QString("Generating coloring page: %1").arg(name));
+    }
+
+    void showGeneratedPage(const GeneratedPage& result) {
+        hideGenerationProgress();
+        logProfile(result);
+        recordProfile(result);
+        abandonStroke();
+
+        coloringPage = result.page;
+        regionIndex = result.regions;
+        hoveredRegion = 0;
+        drawingArea->setHighlight(QRegion());
+
+        history.reset(coloringPage);
+        project.create(sessionPath(), coloringPage);
+
+        // The canvas and the painter work on the page's own pixels.
+        drawingImage = MatImage::wrap(coloringPage);
+        drawingArea->setImage(&drawingImage);
+    }
+
+    void showZoom(double zoom) {
+        zoomLabel->setText(QString("%1%").arg(qRound(zoom * 100.0)));
+    }
+
+    // Per-stage timings go to the "coloring.profile" logging category (QT_LOGGING_RULES
+    // controls it); the total is shown in the status bar.
+    void logProfile(const GeneratedPage& result) {
+        const ColoringPageEngine::Profile& profile = result.profile;
+        qCDebug(profileLog, "%-24s %s", "Backend", profile.backend.c_str());
+        if (result.loadMilliseconds > 0.0) {
+            if (result.decodeReduction > 1) {
+                qCDebug(profileLog, "%-24s %9.2f ms (decoded at 1/%d)", "Load", result.loadMilliseconds, result.decodeReduction);
+            }
+            else {
+                qCDebug(profileLog, "%-24s %9.2f ms", "Load", result.loadMilliseconds);
+            }
+        }
+        qCDebug(profileLog, "%-24s %s", "Edges", profile.edgeDetector.c_str());
+        for (int stage = 0; stage < ColoringPageEngine::stageCount; ++stage) {
+            const char* name = ColoringPageEngine::stageName(static_cast<ColoringPageEngine::Stage>(stage));
+            if (stage < profile.firstStage) {
+                qCDebug(profileLog, "%-24s    cached", name);
+            }
+            else {
+                qCDebug(profileLog, "%-24s %9.2f ms", name, profile.stageMilliseconds[stage]);
+            }
+        }
+        qCDebug(profileLog, "%-24s %9.2f ms", "Region index", result.indexMilliseconds);
+
+        double total = result.loadMilliseconds + profile.totalMilliseconds() + result.indexMilliseconds;
+        statusBar()->showMessage(QString("Page generated in %1 ms (%2)").arg(total, 0, 'f', 1).arg(QString::fromStdString(profile.backend)), 5000);
+    }
+
+    // Cached stages did not run and are left out of their histograms.
+    void recordProfile(const GeneratedPage& result) {
+        const ColoringPageEngine::Profile& profile = result.profile;
+        if (result.loadMilliseconds > 0.0) {
+            telemetry.record("load", result.loadMilliseconds);
+        }
+        for (int stage = profile.firstStage; stage < ColoringPageEngine::stageCount; ++stage) {
+            const char* name = ColoringPageEngine::stageName(static_cast<ColoringPageEngine::Stage>(stage));
+            telemetry.record(QString("stage.%1").arg(name), profile.stageMilliseconds[stage]);
+        }
+        telemetry.record("region_index", result.indexMilliseconds);
+        telemetry.record("page_total", result.loadMilliseconds + profile.totalMilliseconds() + result.indexMilliseconds);
+    }
+
+    void showGenerationError(const QString& message) {
+        hideGenerationProgress();
+        QMessageBox::critical(this, "Error", message);
+    }
+
+    void hideGenerationProgress() {
+        statusBar()->clearMessage();
+        generationProgress->setVisible(false);
+        cancelGenerationButton->setVisible(false);
+    }
+
+    void saveImage() {
+        QString savePath = QFileDialog::getSaveFileName(this, "Save Image", "", "Images (*.png *.jpg *.jpeg);;Vector SVG (*.svg);;Vector PDF (*.pdf);;Coloring project (*.cpproj)");
+        if (!savePath.isEmpty()) {
+            QString suffix = QFileInfo(savePath).suffix().toLower();
+            bool saved = false;
+            if (drawingImage.isNull()) {
+                saved = false;
+            }
+            else if (suffix == "svg") {
+                saved = VectorExport::saveSvg(savePath, coloringPage, regionIndex);
+            }
+            else if (suffix == "pdf") {
+                saved = VectorExport::savePdf(savePath, coloringPage, regionIndex);
+            }
+            else if (suffix == "cpproj") {
+                project.sync();
+                QFile::remove(savePath);
+                saved = QFile::copy(sessionPath(), savePath);
+            }
+            else {
+                saved = drawingImage.save(savePath);
+            }
+
+            if (saved) {
+                QMessageBox::information(this, "Success", "Image saved successfully.");
+            }
+            else {
+                QMessageBox::critical(this, "Error", "Failed to save the image.");
+            }
+        }
+    }
+
+    // Lays the chosen pages out on A4 at 300 DPI in the background, one page per core.
+    void exportBook() {
+        QStringList pagePaths = QFileDialog::getOpenFileNames(this, "Select Pages", "", "Images (*.png *.jpg *.jpeg)");
+        if (pagePaths.isEmpty()) {
+            return;
+        }
+        QString savePath = QFileDialog::getSaveFileName(this, "Export Book", "", "Book PDF (*.pdf);;PNG sheets (*.png)");
+        if (savePath.isEmpty()) {
+            return;
+        }
+
+        exportBookButton->setEnabled(false);
+        statusBar()->showMessage(QString("Exporting %1 pages...").arg(pagePaths.size()));
+        bookExportPool.start([this, pagePaths, savePath]() {
+            auto progress = [this](int written, int count) {
+                QMetaObject::invokeMethod(this, [this, written, count]() {
+                    statusBar()->showMessage(QString("Exported %1 of %2 pages").arg(written).arg(count));
+                }, Qt::QueuedConnection);
+            };
+
+            QFileInfo target(savePath);
+            BookExport::Layout layout;
+            int jobs = QThread::idealThreadCount();
+            QString error;
+            bool saved = target.suffix().toLower() == "png"
+                ? BookExport::savePngs(pagePaths, target.dir().filePath(target.completeBaseName()), layout, jobs, progress, &error)
+                : BookExport::savePdf(pagePaths, savePath, layout, jobs, progress, &error);
+
+            QMetaObject::invokeMethod(this, [this, saved, error]() {
+                exportBookButton->setEnabled(true);
+                statusBar()->clearMessage();
+                if (saved) {
+                    QMessageBox::information(this, "Success", "Book exported successfully.");
+                }
+                else {
+                    QMessageBox::critical(this, "Error", error);
+                }
+            }, Qt::QueuedConnection);
+        });
+    }
+
+public:
+    void setFillColor(const QColor& color) {
+        fillColor = color;
+    }
+
+    void setBrushSize(int width) {
+        brushSize = width;
+    }
+
+    void setPipelineParams(const PipelineParams& params) {
+        generationTask.setParams(params);
+        livePreviewWindow->setParams(params);
+    }
+
+    // Longest edge pages are generated at; 0 keeps the source resolution. Regenerates the
+    // current page, since every stage depends on it.
+    void setProcessingSize(int longEdge) {
+        processingSize = longEdge;
+        if (!currentImagePath.isEmpty()) {
+            generateColoringPage(currentImagePath);
+        }
+        else if (!frozenFrame.empty()) {
+            generateFromFrame(frozenFrame);
+        }
+    }
+
+    void toggleFillTool(bool checked) {
+        fillToolEnabled = checked;
+        if (!checked) {
+            clearRegionHighlight();
+        }
+    }
+
+    void setCloseGaps(bool checked) {
+        closeGaps = checked;
+        clearRegionHighlight();
+    }
+
+    // Regions end at the gap barrier, so they only show what a fill covers when it closes gaps.
+    void highlightRegionAt(const QPoint& point) {
+        int region = fillToolEnabled && closeGaps ? regionIndex.regionAt(cv::Point(point.x(), point.y())) : 0;
+        if (region == hoveredRegion) {
+            return;
+        }
+        hoveredRegion = region;
+
+        QRegion highlight;
+        if (region > 0) {
+            std::vector<QRect> rects;
+            for (const RegionIndex::Span* span = regionIndex.spansBegin(region); span != regionIndex.spansEnd(region); ++span) {
+                rects.emplace_back(span->x0, span->y, span->x1 - span->x0, 1);
+            }
+            highlight.setRects(rects.data(), static_cast<int>(rects.size()));
+        }
+        drawingArea->setHighlight(highlight);
+    }
+
+    void clearRegionHighlight() {
+        hoveredRegion = 0;
+        drawingArea->setHighlight(QRegion());
+    }
+
+    void undoLastAction() {
+        cv::Rect changed;
+        if (history.undo(coloringPage, &changed)) {
+            drawingArea->refresh(QRect(changed.x, changed.y, changed.width, changed.height));
+            project.append(PageOperation{ PageOperation::Undo });
+        }
+    }
+
+    void redoLastAction() {
+        cv::Rect changed;
+        if (history.redo(coloringPage, &changed)) {
+            drawingArea->refresh(QRect(changed.x, changed.y, changed.width, changed.height));
+            project.append(PageOperation{ PageOperation::Redo });
+        }
+    }
+
+private:
+    static QString sessionPath() {
+        QString directory = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+        QDir().mkpath(directory);
+        return QDir(directory).filePath("session.cpproj");
+    }
+
+    void beginStroke(const QPointF& point, double pressure) {
+        strokes.begin(&drawingImage, fillColor, brushSize, point, pressure);
+        strokeTimer.start();
+    }
+
+    void flushStroke() {
+        double frameMilliseconds = 0.0;
+        QRect dirtyRect;
+        {
+            ScopedTimer timer(frameMilliseconds);
+            dirtyRect = strokes.flush();
+            if (!dirtyRect.isEmpty()) {
+                drawingArea->refresh(dirtyRect);
+            }
+        }
+        if (!dirtyRect.isEmpty()) {
+            telemetry.record("brush_frame", frameMilliseconds);
+        }
+    }
+
+    void endStroke() {
+        if (!strokes.isActive()) {
+            return;
+        }
+        strokeTimer.stop();
+        flushStroke();
+        QRect strokeRect = strokes.end();
+        if (!strokeRect.isEmpty()) {
+            history.commit(coloringPage, cv::Rect(strokeRect.x(), strokeRect.y(), strokeRect.width(), strokeRect.height()));
+            project.append(PageOperation{ PageOperation::Stroke, fillColor.rgba(), static_cast<float>(brushSize), strokes.points(), strokes.pressures() });
+        }
+    }
+
+    // Drops a stroke in progress without recording it, before the page image goes away.
+    void abandonStroke() {
+        strokeTimer.stop();
+        strokes.end();
+    }
+
+    // Fills the region under point, or with allOfColor every region of its color. With
+    // stopAtGaps the fill treats the gap barrier as lines. Returns the rectangle that changed.
+    // Throws cv::Exception.
+    cv::Rect applyFill(const QPoint& point, const QColor& fill, bool allOfColor, bool stopAtGaps) {
+        cv::Point seed(point.x(), point.y());
+        cv::Vec3b color(fill.blue(), fill.green(), fill.red());
+        int region = regionIndex.regionAt(seed);
+        fillEngine.setWalls(stopAtGaps ? regionIndex.barrier() : cv::Mat());
+
+        cv::Rect filledRect;
+        if (region > 0 && allOfColor) {
+            cv::Vec3b current = coloringPage.at<cv::Vec3b>(seed);
+            filledRect = regionIndex.fillAllOfColor(coloringPage, current, color, stopAtGaps);
+        }
+        else if (region == 0 || !regionIndex.fillRegion(coloringPage, region, color, stopAtGaps, &filledRect)) {
+            filledRect = fillEngine.fill(coloringPage, seed, cv::Scalar(color[0], color[1], color[2]));
+        }
+        return filledRect;
+    }
+
+    // Shows the line art of contents and replays its operations through the same fill,
+    // stroke and history calls the editing went through, which rebuilds the undo history.
+    void restoreProject(const ProjectFile::Contents& contents) {
+        generationTask.cancel();
+        abandonStroke();
+        currentImagePath.clear();
+        frozenFrame.release();
+
+        coloringPage = contents.lineArt.clone();
+        regionIndex.build(coloringPage);
+        hoveredRegion = 0;
+        drawingArea->setHighlight(QRegion());
+        history.reset(coloringPage);
+        drawingImage = MatImage::wrap(coloringPage);
+
+        try {
+            for (const PageOperation& operation : contents.operations) {
+                replayOperation(operation);
+            }
+        }
+        catch (cv::Exception& e) {
+            QMessageBox::warning(this, "Restore", QString("Some edits could not be restored: %1").arg(e.what()));
+        }
+
+        drawingArea->setImage(&drawingImage);
+        statusBar()->showMessage(QString("Restored %1 edits").arg(contents.operations.size()), 5000);
+    }
+
+    void replayOperation(const PageOperation& operation) {
+        QColor color = QColor::fromRgba(operation.color);
+        switch (operation.kind) {
+        case PageOperation::Fill:
+        case PageOperation::FillAllOfColor:
+            if (!operation.points.empty()) {
+                cv::Rect filledRect = applyFill(operation.points.front().toPoint(), color, operation.kind == PageOperation::FillAllOfColor, operation.closeGaps);
+                if (!filledRect.empty()) {
+                    history.commit(coloringPage, filledRect);
+                }
+            }
+            break;
+
+        case PageOperation::Stroke: {
+            if (operation.points.empty() || operation.pressures.size() != operation.points.size()) {
+                break;
+            }
+            strokes.begin(&drawingImage, color, operation.width, operation.points.front(), operation.pressures.front());
+            for (size_t i = 1; i < operation.points.size(); ++i) {
+                strokes.addPoint(operation.points[i], operation.pressures[i]);
+            }
+            QRect touched = strokes.end();
+            if (!touched.isEmpty()) {
+                history.commit(coloringPage, cv::Rect(touched.x(), touched.y(), touched.width(), touched.height()));
+            }
+            break;
+        }
+
+        case PageOperation::Undo:
+            history.undo(coloringPage);
+            break;
+
+        case PageOperation::Redo:
+            history.redo(coloringPage);
+            break;
+        }
+    }
+
+    // Maps a position in this window to page coordinates.
+    QPoint pagePoint(const QPoint& position) const {
+        return drawingArea->mapToImage(drawingArea->mapFrom(this, position));
+    }
+
+    QPointF pagePoint(const QPointF& position) const {
+        return drawingArea->mapToImage(drawingArea->mapFrom(this, position));
+    }
+
+    DrawingCanvas* drawingArea;
+    // Shares coloringPage's buffer; never copy it, or painting would detach the copy.
+    QImage drawingImage;
+    StrokeEngine strokes;
+    QTimer strokeTimer;
+    int brushSize = 1;
+    cv::Mat coloringPage;
+    PageGenerationTask generationTask;
+    QString currentImagePath;
+    // The camera frame the page came from, when it came from the live preview.
+    cv::Mat frozenFrame;
+    int processingSize = 0;
+    QLabel* zoomLabel;
+    QProgressBar* generationProgress;
+    QPushButton* cancelGenerationButton;
+    QPushButton* exportBookButton;
+    FillEngine fillEngine;
+    RegionIndex regionIndex;
+    int hoveredRegion = 0;
+    PageHistory history;
+    ImageControlsWindow* imageControlsWindow;
+    LivePreviewWindow* livePreviewWindow;
+    QColor fillColor;
+    bool fillToolEnabled;
+    bool closeGaps = true;
+    ProjectFile project;
+    QTimer autosaveTimer;
+    Telemetry telemetry;
+    // Last, so a running export finishes before the rest of the window goes away.
+    QThreadPool bookExportPool;
+};
+
+static bool isHeadlessInvocation(int argc, char** argv) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--batch") == 0 || std::strcmp(argv[i], "--watch") == 0 || std::strcmp(argv[i], "--book") == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void attachParentConsole() {
+#ifdef Q_OS_WIN
+    // The app is linked for the Windows subsystem, so it has no console of its own.
+    if (AttachConsole(ATTACH_PARENT_PROCESS)) {
+        std::freopen("CONOUT$", "w", stdout);
+        std::freopen("CONOUT$", "w", stderr);
+    }
+#endif
+}
+
+// Matches QPageSize keys such as "A4" or "Letter", ignoring case.
+static bool pageSizeFromName(const QString& name, QPageSize* pageSize) {
+    for (int id = 0; id <= QPageSize::LastPageSize; ++id) {
+        QPageSize candidate(static_cast<QPageSize::PageSizeId>(id));
+        if (candidate.isValid() && candidate.key().compare(name, Qt::CaseInsensitive) == 0) {
+            *pageSize = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Lays every page of in_dir out for print, into out.pdf or as PNG sheets in the out directory.
+static int runBookExport(const QString& pagesDir, const QString& target, const BookExport::Layout& layout, int jobs) {
+    QFileInfoList files = QDir(pagesDir).entryInfoList({ "*.png", "*.jpg", "*.jpeg" }, QDir::Files, QDir::Name);
+    if (files.isEmpty()) {
+        std::fprintf(stderr, "No pages found in %s\n", qUtf8Printable(pagesDir));
+        return 1;
+    }
+    QStringList pagePaths;
+    for (const QFileInfo& file : files) {
+        pagePaths << file.absoluteFilePath();
+    }
+
+    auto progress = [](int written, int count) {
+        std::printf("\r%d/%d pages", written, count);
+        std::fflush(stdout);
+    };
+
+    QElapsedTimer timer;
+    timer.start();
+    QString error;
+    bool saved = false;
+    if (QFileInfo(target).suffix().toLower() == "pdf") {
+        saved = BookExport::savePdf(pagePaths, target, layout, jobs, progress, &error);
+    }
+    else if (QDir().mkpath(target)) {
+        saved = BookExport::savePngs(pagePaths, QDir(target).filePath("page"), layout, jobs, progress, &error);
+    }
+    else {
+        error = "Failed to create output directory: " + target;
+    }
+    std::printf("\n");
+
+    if (!saved) {
+        std::fprintf(stderr, "%s\n", qUtf8Printable(error));
+        return 2;
+    }
+    std::printf("%d pages on %s at %d DPI in %.2f s\n", static_cast<int>(pagePaths.size()), qUtf8Printable(layout.paper.name()),
+        layout.dpi, timer.nsecsElapsed() / 1e9);
+    return 0;
+}
+
+// --batch converts a directory once; --watch keeps converting whatever arrives in it; --book
+// lays a directory of finished pages out for print.
+static int runHeadless(QCoreApplication& app) {
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Converts every image in a directory into a coloring page.");
+    parser.addHelpOption();
+    parser.addOption(QCommandLineOption("batch", "Run without a window."));
+    QCommandLineOption watchOption("watch", "Run as a service converting every image that arrives in in_dir.");
+    parser.addOption(watchOption);
+    QCommandLineOption bookOption("book", "Lay the pages in in_dir out for print, into out.pdf or as PNG sheets in the out directory.");
+    parser.addOption(bookOption);
+    QCommandLineOption paperOption("paper", "Paper size of --book sheets, e.g. A4 or Letter.", "name", "A4");
+    parser.addOption(paperOption);
+    QCommandLineOption dpiOption("dpi", "Print resolution of --book sheets.", "N", "300");
+    parser.addOption(dpiOption);
+    QCommandLineOption metricsIntervalOption("metrics-interval", "Seconds between queue and latency reports in --watch mode.", "S", "10");
+    parser.addOption(metricsIntervalOption);
+    QCommandLineOption jobsOption("jobs", "Number of images processed in parallel.", "N", QString::number(QThread::idealThreadCount()));
+    parser.addOption(jobsOption);
+    QCommandLineOption fusedThresholdOption("fused-threshold", "Use the fused grayscale + threshold pass.");
+    parser.addOption(fusedThresholdOption);
+    QCommandLineOption tileSizeOption("tile-size", "Threshold and close the line art in tiles of N pixels, for very large images.", "N", "0");
+    parser.addOption(tileSizeOption);
+    QCommandLineOption openCLOption("opencl", "Run resize, threshold and closing on the OpenCL device when there is one.");
+    parser.addOption(openCLOption);
+    QCommandLineOption edgesOption("edges", "Line extractor: adaptive, canny, xdog or model.", "name", "adaptive");
+    parser.addOption(edgesOption);
+    QCommandLineOption lineArtModelOption("line-art-model", "Network file for --edges model, in a format cv::dnn reads.", "path");
+    parser.addOption(lineArtModelOption);
+    parser.addPositionalArgument("in_dir", "Directory with source images.");
+    parser.addPositionalArgument("out_dir", "Directory the coloring pages are written to, or the book's PDF.");
+    parser.process(app);
+
+    QStringList directories = parser.positionalArguments();
+    if (directories.size() != 2) {
+        std::fprintf(stderr, "Usage: app --batch|--watch in_dir out_dir [--jobs N] [--fused-threshold] [--tile-size N] [--opencl]\n"
+            "           [--edges adaptive|canny|xdog|model] [--line-art-model path] [--metrics-interval S]\n"
+            "       app --book pages_dir out.pdf|out_dir [--jobs N] [--paper A4] [--dpi 300]\n");
+        return 1;
+    }
+
+    bool jobsValid = false;
+    int jobs = parser.value(jobsOption).toInt(&jobsValid);
+    if (!jobsValid || jobs < 1) {
+        std::fprintf(stderr, "--jobs expects a positive number\n");
+        return 1;
+    }
+
+    if (parser.isSet(bookOption)) {
+        BookExport::Layout layout;
+        if (!pageSizeFromName(parser.value(paperOption), &layout.paper)) {
+            std::fprintf(stderr, "Unknown paper size: %s\n", qUtf8Printable(parser.value(paperOption)));
+            return 1;
+        }
+        bool dpiValid = false;
+        layout.dpi = parser.value(dpiOption).toInt(&dpiValid);
+        if (!dpiValid || layout.dpi < 1) {
+            std::fprintf(stderr, "--dpi expects a positive number\n");
+            return 1;
+        }
+        return runBookExport(directories[0], directories[1], layout, jobs);
+    }
+
+    bool tileSizeValid = false;
+    int tileSize = parser.value(tileSizeOption).toInt(&tileSizeValid);
+    if (!tileSizeValid || tileSize < 0) {
+        std::fprintf(stderr, "--tile-size expects a number of pixels, or 0 to disable tiling\n");
+        return 1;
+    }
+
+    PipelineParams params;
+    params.fusedThreshold = parser.isSet(fusedThresholdOption);
+    params.tileSize = tileSize;
+    params.useOpenCL = parser.isSet(openCLOption);
+    if (!edgeMethodFromName(parser.value(edgesOption).toStdString(), &params.edgeMethod)) {
+        std::fprintf(stderr, "Unknown line extractor: %s\n", qUtf8Printable(parser.value(edgesOption)));
+        return 1;
+    }
+    params.lineArtModel = parser.value(lineArtModelOption).toStdString();
+    if (params.edgeMethod == EdgeMethod::LineArtModel && params.lineArtModel.empty()) {
+        std::fprintf(stderr, "--edges model needs --line-art-model\n");
+        return 1;
+    }
+
+    if (parser.isSet(watchOption)) {
+        WatchFolderService service(directories[0], directories[1], jobs, params, parser.value(metricsIntervalOption).toInt());
+        if (!service.start()) {
+            return 1;
+        }
+        return app.exec();
+    }
+
+    BatchProcessor processor(directories[0], directories[1], jobs, params);
+    return processor.run();
+}
+
+int main(int argc, char** argv) {
+    if (isHeadlessInvocation(argc, argv)) {
+        attachParentConsole();
+        QCoreApplication app(argc, argv);
+        return runHeadless(app);
+    }
+
+    QApplication app(argc, argv);
+
+    ColoringPageGenerator generator;
+    generator.showMaximized();
+
+    ImageControlsWindow imageControlsWindow;
+    imageControlsWindow.show();
+
+    QObject::connect(&imageControlsWindow, &ImageControlsWindow::colorPicked, &generator, &ColoringPageGenerator::setFillColor);
+    QObject::connect(&imageControlsWindow, &ImageControlsWindow::brushSizeChanged, &generator, &ColoringPageGenerator::setBrushSize);
+    QObject::connect(&imageControlsWindow, &ImageControlsWindow::fillToggled, &generator, &ColoringPageGenerator::toggleFillTool);
+    QObject::connect(&imageControlsWindow, &ImageControlsWindow::closeGapsToggled, &generator, &ColoringPageGenerator::setCloseGaps);
+    QObject::connect(&imageControlsWindow, &ImageControlsWindow::undoAction, &generator, &ColoringPageGenerator::undoLastAction);
+    QObject::connect(&imageControlsWindow, &ImageControlsWindow::redoAction, &generator, &ColoringPageGenerator::redoLastAction);
+    QObject::connect(&imageControlsWindow, &ImageControlsWindow::pipelineParamsChanged, &generator, &ColoringPageGenerator::setPipelineParams);
+    QObject::connect(&imageControlsWindow, &ImageControlsWindow::processingSizeChanged, &generator, &ColoringPageGenerator::setProcessingSize);
+
+    return app.exec();
+}
+
+#include "main.moc"
+
@@ -0,0 +1,508 @@
+#include <opencv2/opencv.hpp>
+
+#include <QColor>
+#include <QDir>
+#include <QFile>
+#include <QImage>
+#include <QPointF>
+
+#include "../app/ColoringPageEngine.h"
+#include "../app/EdgeDetector.h"
+#include "../app/FusedThreshold.h"
+#include "../app/PixelKernels.h"
+#include "../app/ProjectFile.h"
+#include "../app/RectMorphology.h"
+#include "../app/ScopedTimer.h"
+#include "../app/StrokeEngine.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Runs the generation pipeline over a fixed corpus at several page sizes and reports the
+// median and 95th percentile of every stage, followed by an A/B of the OpenCV and fused
+// grayscale + threshold paths and the cost of every line extractor.
+//
+//   benchmark [--corpus dir] [--sizes 640,1280,1920,3840] [--runs N] [--opencl]
+//             [--edges adaptive|canny|xdog|model] [--line-art-model path]
+//
+// The line-art model joins the extractor comparison only when --line-art-model is given.
+//
+// Without --corpus a deterministic synthetic corpus is generated, so results are comparable
+// between machines and commits.
+
+struct CorpusImage {
+    std::string name;
+    std::string path;
+    cv::Mat image;
+};
+
+static std::vector<CorpusImage> loadCorpus(const std::string& directory) {
+    std::vector<cv::String> paths;
+    for (const char* pattern : { "/*.png", "/*.jpg", "/*.jpeg" }) {
+        std::vector<cv::String> matches;
+        cv::glob(directory + pattern, matches, false);
+        paths.insert(paths.end(), matches.begin(), matches.end());
+    }
+    std::sort(paths.begin(), paths.end());
+
+    std::vector<CorpusImage> corpus;
+    for (const cv::String& path : paths) {
+        cv::Mat image = cv::imread(path);
+        if (image.empty()) {
+            std::fprintf(stderr, "Skipping unreadable image %s\n", path.c_str());
+            continue;
+        }
+        corpus.push_back({ path.substr(path.find_last_of("/\\") + 1), path, image });
+    }
+    return corpus;
+}
+
+// Photo-like test images: smooth gradients, overlapping shapes, text and sensor noise.
+static std::vector<CorpusImage> syntheticCorpus() {
+    std::vector<CorpusImage> corpus;
+    cv::RNG rng(0x5eed);
+
+    for (int index = 0; index < 4; ++index) {
+        cv::Mat image(3024, 4032, CV_8UC3);
+        for (int y = 0; y < image.rows; ++y) {
+            cv::Vec3b* row = image.ptr<cv::Vec3b>(y);
+            for (int x = 0; x < image.cols; ++x) {
+                row[x] = cv::Vec3b(static_cast<uchar>(x * 255 / image.cols), static_cast<uchar>(y * 255 / image.rows), static_cast<uchar>(128 + index * 30));
+            }
+        }
+
+        for (int shape = 0; shape < 150 + index * 100; ++shape) {
+            cv::Point center(rng.uniform(0, image.cols), rng.uniform(0, image.rows));
+            cv::Scalar color(rng.uniform(0, 256), rng.uniform(0, 256), rng.uniform(0, 256));
+            if (shape % 3 == 0) {
+                cv::circle(image, center, rng.uniform(20, 400), color, cv::FILLED, cv::LINE_AA);
+            }
+            else if (shape % 3 == 1) {
+                cv::rectangle(image, cv::Rect(center.x, center.y, rng.uniform(20, 600), rng.uniform(20, 600)), color, cv::FILLED);
+            }
+            else {
+                cv::putText(image, "coloring", center, cv::FONT_HERSHEY_SIMPLEX, rng.uniform(1.0, 6.0), color, rng.uniform(2, 12), cv::LINE_AA);
+            }
+        }
+
+        cv::Mat noisy;
+        cv::Mat noise(image.size(), CV_16SC3);
+        rng.fill(noise, cv::RNG::NORMAL, 0, 6);
+        image.convertTo(noisy, CV_16SC3);
+        noisy += noise;
+        noisy.convertTo(image, CV_8UC3);
+
+        corpus.push_back({ "synthetic-" + std::to_string(index), std::string(), image });
+    }
+    return corpus;
+}
+
+static double percentile(std::vector<double> samples, double fraction) {
+    if (samples.empty()) {
+        return 0.0;
+    }
+    std::sort(samples.begin(), samples.end());
+    size_t rank = static_cast<size_t>(fraction * (samples.size() - 1) + 0.5);
+    return samples[std::min(rank, samples.size() - 1)];
+}
+
+// The fast morphology has to be bit-identical to OpenCV; checked on every corpus image.
+static bool verifyMorphology(const cv::Mat& image, const cv::Size& pageSize) {
+    cv::Mat resized;
+    cv::Mat grayscale;
+    cv::Mat binary;
+    cv::resize(image, resized, pageSize);
+    cv::cvtColor(resized, grayscale, cv::COLOR_BGR2GRAY);
+    cv::adaptiveThreshold(grayscale, binary, 255, cv::ADAPTIVE_THRESH_MEAN_C, cv::THRESH_BINARY_INV, 15, 10);
+
+    RectMorphology morphology;
+    for (int size : { 1, 2, 5, 30, 61 }) {
+        for (const cv::Mat& source : { grayscale, binary }) {
+            cv::Size kernelSize(size, size + 3);
+            cv::Mat kernel = cv::getStructuringElement(cv::MORPH_RECT, kernelSize);
+            cv::Mat expected;
+            cv::Mat actual;
+
+            cv::dilate(source, expected, kernel);
+            morphology.dilate(source, actual, kernelSize);
+            if (cv::norm(expected, actual, cv::NORM_INF) != 0) {
+                return false;
+            }
+
+            cv::erode(source, expected, kernel);
+            morphology.erode(source, actual, kernelSize);
+            if (cv::norm(expected, actual, cv::NORM_INF) != 0) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// The batched contour post-processing, one draw and one closing, has to give the raster of
+// the original loop that drew every contour and closed the whole canvas after each one.
+static bool verifyContourPostProcessing(const cv::Mat& image, const cv::Size& pageSize) {
+    ColoringPageEngine engine;
+    const PipelineParams& params = engine.params();
+    engine.generateColoringPage(image, pageSize, [](ColoringPageEngine::Stage stage) {
+        return stage != ColoringPageEngine::Stage::ContourMask;
+    });
+
+    cv::Mat expected = engine.closedMask().clone();
+    std::vector<std::vector<cv::Point>> contours;
+    cv::findContours(expected, contours, cv::RETR_TREE, cv::CHAIN_APPROX_SIMPLE);
+    contours.erase(std::remove_if(contours.begin(), contours.end(), [&params](const std::vector<cv::Point>& contour) {
+        return cv::contourArea(contour) < params.minContourArea;
+    }), contours.end());
+
+    cv::Mat kernelClosing = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(params.maskClosingSize, params.maskClosingSize));
+    for (std::vector<cv::Point>& contour : contours) {
+        cv::approxPolyDP(contour, contour, params.contourEpsilon, true);
+        cv::drawContours(expected, std::vector<std::vector<cv::Point>>{ contour }, 0, cv::Scalar(0), params.contourThickness, cv::LINE_AA);
+        cv::morphologyEx(expected, expected, cv::MORPH_CLOSE, kernelClosing);
+    }
+
+    return cv::norm(expected, engine.contourRaster(), cv::NORM_INF) == 0;
+}
+
+// The pixel kernels have to match the OpenCV calls they replace; checked on the thresholded
+// page, with odd widths so the block loops leave tails.
+static bool verifyPixelKernels(const cv::Mat& image, const cv::Size& pageSize) {
+    cv::Mat resized;
+    cv::Mat grayscale;
+    cv::Mat binary;
+    cv::resize(image, resized, pageSize);
+    cv::cvtColor(resized, grayscale, cv::COLOR_BGR2GRAY);
+    cv::adaptiveThreshold(grayscale, binary, 255, cv::ADAPTIVE_THRESH_MEAN_C, cv::THRESH_BINARY_INV, 15, 10);
+
+    cv::Mat expected(binary.size(), CV_8UC3, cv::Scalar(255, 255, 255));
+    expected.setTo(cv::Scalar(0, 0, 0), binary);
+    cv::Mat actual;
+    PixelKernels::select<3>(binary, actual, cv::Vec3b(0, 0, 0), cv::Vec3b(255, 255, 255));
+    if (cv::norm(expected, actual, cv::NORM_INF) != 0) {
+        return false;
+    }
+
+    cv::Mat masked;
+    cv::bitwise_and(grayscale, binary, expected);
+    grayscale.copyTo(masked);
+    PixelKernels::applyMask<1>(masked, binary);
+    if (cv::norm(expected, masked, cv::NORM_INF) != 0) {
+        return false;
+    }
+
+    const cv::Vec3b color(40, 120, 200);
+    cv::Rect area(1, 1, std::max(1, binary.cols - 3), std::max(1, binary.rows - 2));
+    cv::Mat marks = binary.clone();
+    resized.copyTo(expected);
+    resized.copyTo(actual);
+    expected(area).setTo(cv::Scalar(color[0], color[1], color[2]), binary(area));
+    PixelKernels::paintAndClear<3>(actual(area), marks(area), 255, color);
+    if (cv::norm(expected, actual, cv::NORM_INF) != 0 || cv::countNonZero(marks(area)) != 0) {
+        return false;
+    }
+
+    expected(area).setTo(cv::Scalar(color[2], color[1], color[0]));
+    for (int y = area.y; y < area.br().y; ++y) {
+        PixelKernels::fillRow<3>(actual.ptr<uchar>(y, area.x), area.width, cv::Vec3b(color[2], color[1], color[0]));
+    }
+    return cv::norm(expected, actual, cv::NORM_INF) == 0 && PixelKernels::rowEquals<3>(actual.ptr<uchar>(area.y, area.x), area.width, cv::Vec3b(color[2], color[1], color[0]));
+}
+
+struct ThresholdComparison {
+    std::vector<double> openCvSamples;
+    std::vector<double> fusedSamples;
+    long long mismatchedPixels = 0;
+    long long pixels = 0;
+};
+
+// Times cvtColor + adaptiveThreshold against FusedThreshold on the resized page and counts
+// the pixels where the two masks disagree.
+static void compareThreshold(const cv::Mat& image, const cv::Size& pageSize, const PipelineParams& params, int runs, ThresholdComparison& comparison) {
+    cv::Mat resized;
+    cv::resize(image, resized, pageSize);
+
+    cv::Mat grayscale;
+    cv::Mat expected;
+    cv::Mat actual;
+    for (int run = 0; run <= runs; ++run) {
+        double openCvMilliseconds = 0.0;
+        {
+            ScopedTimer timer(openCvMilliseconds);
+            cv::cvtColor(resized, grayscale, cv::COLOR_BGR2GRAY);
+            cv::adaptiveThreshold(grayscale, expected, 255, cv::ADAPTIVE_THRESH_MEAN_C, cv::THRESH_BINARY_INV, params.thresholdBlockSize, params.thresholdC);
+        }
+        double fusedMilliseconds = 0.0;
+        {
+            ScopedTimer timer(fusedMilliseconds);
+            FusedThreshold::apply(resized, actual, params.thresholdBlockSize, params.thresholdC);
+        }
+        // Run 0 is the warm-up.
+        if (run > 0) {
+            comparison.openCvSamples.push_back(openCvMilliseconds);
+            comparison.fusedSamples.push_back(fusedMilliseconds);
+        }
+    }
+
+    cv::Mat difference;
+    cv::compare(expected, actual, difference, cv::CMP_NE);
+    comparison.mismatchedPixels += cv::countNonZero(difference);
+    comparison.pixels += static_cast<long long>(expected.total());
+}
+
+struct EdgeComparison {
+    EdgeMethod method;
+    std::string name;
+    // Grayscale and Threshold stages, the part the extractor decides.
+    std::vector<double> edgeSamples;
+    std::vector<double> totalSamples;
+};
+
+// Runs the whole pipeline once per extractor and run; later stages are included in the total
+// because the lines an extractor finds change the contour work after it.
+static void compareEdgeDetectors(const cv::Mat& image, const cv::Size& pageSize, const PipelineParams& params, int runs, std::vector<EdgeComparison>& comparisons) {
+    for (EdgeComparison& comparison : comparisons) {
+        PipelineParams methodParams = params;
+        methodParams.edgeMethod = comparison.method;
+        ColoringPageEngine engine;
+        engine.setParams(methodParams);
+        for (int run = 0; run <= runs; ++run) {
+            engine.generateColoringPage(image, pageSize);
+            const ColoringPageEngine::Profile& profile = engine.lastProfile();
+            comparison.name = profile.edgeDetector;
+            // Run 0 is the warm-up, and loads the model.
+            if (run > 0) {
+                comparison.edgeSamples.push_back(profile.stageMilliseconds[static_cast<int>(ColoringPageEngine::Stage::Grayscale)]
+                    + profile.stageMilliseconds[static_cast<int>(ColoringPageEngine::Stage::Threshold)]);
+                comparison.totalSamples.push_back(profile.totalMilliseconds());
+            }
+        }
+    }
+}
+
+// A stroke restored from the project log has to draw the pixels the live stroke drew. The
+// live stroke has fractional points, as at a non-integer zoom, and is flushed every few
+// points like the window's frames; it is saved through ProjectFile, read back and replayed
+// in one flush.
+static bool verifyStrokeReplay() {
+    const int pointCount = 600;
+    const double width = 9.0;
+    const QColor color(200, 40, 120);
+    auto point = [](int i) {
+        double t = i * 0.05;
+        return QPointF(320.0 + (20.0 + 0.3 * i) * std::cos(t) / 1.37, 240.0 + (20.0 + 0.3 * i) * std::sin(t) / 1.37);
+    };
+    auto pressure = [](int i) {
+        return 0.2 + 0.8 * std::abs(std::sin(i * 0.13));
+    };
+
+    QImage live(640, 480, QImage::Format_BGR888);
+    live.fill(Qt::white);
+    QImage replayed = live.copy();
+
+    StrokeEngine strokes;
+    strokes.begin(&live, color, width, point(0), pressure(0));
+    for (int i = 1; i < pointCount; ++i) {
+        strokes.addPoint(point(i), pressure(i));
+        if (i % 7 == 0) {
+            strokes.flush();
+        }
+    }
+    strokes.end();
+
+    const QString path = QDir(QDir::tempPath()).filePath("benchmark-stroke-replay.cpproj");
+    {
+        ProjectFile project;
+        project.create(path, cv::Mat(1, 1, CV_8UC3, cv::Scalar(255, 255, 255)));
+        project.append(PageOperation{ PageOperation::Stroke, color.rgba(), static_cast<float>(width), strokes.points(), strokes.pressures() });
+        project.sync();
+    }
+    ProjectFile::Contents contents;
+    bool readBack = ProjectFile::read(path, contents);
+    QFile::remove(path);
+    if (!readBack || contents.operations.size() != 1 || contents.operations.front().points.empty()) {
+        return false;
+    }
+
+    const PageOperation& stroke = contents.operations.front();
+    strokes.begin(&replayed, QColor::fromRgba(stroke.color), stroke.width, stroke.points.front(), stroke.pressures.front());
+    for (size_t i = 1; i < stroke.points.size(); ++i) {
+        strokes.addPoint(stroke.points[i], stroke.pressures[i]);
+    }
+    strokes.end();
+    return live == replayed;
+}
+
+// Tiles must not change the page; checked with a tile size that leaves partial tiles.
+static bool verifyTiling(const cv::Mat& image, const cv::Size& pageSize) {
+    ColoringPageEngine whole;
+    cv::Mat expected = whole.generateColoringPage(image, pageSize);
+
+    PipelineParams params;
+    params.tileSize = 300;
+    ColoringPageEngine tiled;
+    tiled.setParams(params);
+    cv::Mat actual = tiled.generateColoringPage(image, pageSize);
+
+    return cv::norm(expected, actual, cv::NORM_INF) == 0;
+}
+
+static void printRow(const char* name, const std::vector<double>& samples) {
+    std::printf("  %-24s %10.2f %10.2f\n", name, percentile(samples, 0.5), percentile(samples, 0.95));
+}
+
+static std::vector<int> parseSizes(const char* text) {
+    std::vector<int> sizes;
+    for (const char* cursor = text; *cursor;) {
+        char* end = nullptr;
+        long size = std::strtol(cursor, &end, 10);
+        if (end == cursor) {
+            break;
+        }
+        if (size > 0) {
+            sizes.push_back(static_cast<int>(size));
+        }
+        cursor = *end == ',' ? end + 1 : end;
+    }
+    return sizes;
+}
+
+int main(int argc, char** argv) {
+    std::string corpusDirectory;
+    std::vector<int> sizes = { 640, 1280, 1920, 3840 };
+    int runs = 5;
+    PipelineParams params;
+
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--corpus") == 0 && i + 1 < argc) {
+            corpusDirectory = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--sizes") == 0 && i + 1 < argc) {
+            sizes = parseSizes(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+            runs = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (std::strcmp(argv[i], "--opencl") == 0) {
+            params.useOpenCL = true;
+        }
+        else if (std::strcmp(argv[i], "--edges") == 0 && i + 1 < argc && edgeMethodFromName(argv[i + 1], &params.edgeMethod)) {
+            ++i;
+        }
+        else if (std::strcmp(argv[i], "--line-art-model") == 0 && i + 1 < argc) {
+            params.lineArtModel = argv[++i];
+        }
+        else {
+            std::fprintf(stderr, "Usage: benchmark [--corpus dir] [--sizes 640,1280,...] [--runs N] [--opencl]\n"
+                "                 [--edges adaptive|canny|xdog|model] [--line-art-model path]\n");
+            return 1;
+        }
+    }
+    if (params.edgeMethod == EdgeMethod::LineArtModel && params.lineArtModel.empty()) {
+        std::fprintf(stderr, "--edges model needs --line-art-model\n");
+        return 1;
+    }
+
+    std::vector<EdgeMethod> edgeMethods = { EdgeMethod::AdaptiveThreshold, EdgeMethod::PyramidCanny, EdgeMethod::XDoG };
+    if (!params.lineArtModel.empty()) {
+        edgeMethods.push_back(EdgeMethod::LineArtModel);
+    }
+
+    std::vector<CorpusImage> corpus = corpusDirectory.empty() ? syntheticCorpus() : loadCorpus(corpusDirectory);
+    if (corpus.empty() || sizes.empty()) {
+        std::fprintf(stderr, "Nothing to benchmark.\n");
+        return 1;
+    }
+
+    if (!verifyStrokeReplay()) {
+        std::fprintf(stderr, "A stroke replayed from the project log differs from the live stroke\n");
+        return 2;
+    }
+
+    std::printf("%d images, %d runs each, OpenCV %s, %d threads\n", static_cast<int>(corpus.size()), runs, CV_VERSION, cv::getNumThreads());
+
+    ColoringPageEngine engine;
+    engine.setParams(params);
+    for (int size : sizes) {
+        std::vector<std::vector<double>> stageSamples(ColoringPageEngine::stageCount);
+        std::vector<double> loadSamples;
+        std::vector<double> totalSamples;
+        ThresholdComparison thresholdComparison;
+        std::vector<EdgeComparison> edgeComparisons;
+        for (EdgeMethod method : edgeMethods) {
+            edgeComparisons.push_back({ method, std::string(), {}, {} });
+        }
+
+        for (const CorpusImage& entry : corpus) {
+            cv::Size pageSize = ColoringPageEngine::fitSize(entry.image.size(), cv::Size(size, size));
+            if (!verifyMorphology(entry.image, pageSize)) {
+                std::fprintf(stderr, "RectMorphology differs from OpenCV on %s at %dx%d\n", entry.name.c_str(), pageSize.width, pageSize.height);
+                return 2;
+            }
+            if (!verifyContourPostProcessing(entry.image, pageSize)) {
+                std::fprintf(stderr, "Batched contour post-processing differs from the per-contour loop on %s at %dx%d\n", entry.name.c_str(), pageSize.width, pageSize.height);
+                return 2;
+            }
+            if (!verifyPixelKernels(entry.image, pageSize)) {
+                std::fprintf(stderr, "PixelKernels differ from OpenCV on %s at %dx%d\n", entry.name.c_str(), pageSize.width, pageSize.height);
+                return 2;
+            }
+            if (!verifyTiling(entry.image, pageSize)) {
+                std::fprintf(stderr, "Tiled processing differs from whole-page processing on %s at %dx%d\n", entry.name.c_str(), pageSize.width, pageSize.height);
+                return 2;
+            }
+
+            compareThreshold(entry.image, pageSize, engine.params(), runs, thresholdComparison);
+            compareEdgeDetectors(entry.image, pageSize, engine.params(), runs, edgeComparisons);
+
+            // One untimed run so allocations and lazy initialisation stay out of the numbers.
+            engine.generateColoringPage(entry.image, pageSize);
+
+            for (int run = 0; run < runs; ++run) {
+                if (!entry.path.empty()) {
+                    double loadMilliseconds = 0.0;
+                    {
+                        ScopedTimer timer(loadMilliseconds);
+                        cv::imread(entry.path);
+                    }
+                    loadSamples.push_back(loadMilliseconds);
+                }
+
+                engine.generateColoringPage(entry.image, pageSize);
+                const ColoringPageEngine::Profile& profile = engine.lastProfile();
+                for (int stage = 0; stage < ColoringPageEngine::stageCount; ++stage) {
+                    stageSamples[stage].push_back(profile.stageMilliseconds[stage]);
+                }
+                totalSamples.push_back(profile.totalMilliseconds());
+            }
+        }
+
+        std::printf("\npage fitted into %dx%d, %s, %s\n", size, size, engine.lastProfile().backend.c_str(), engine.lastProfile().edgeDetector.c_str());
+        std::printf("  %-24s %10s %10s\n", "stage", "median ms", "p95 ms");
+        if (!loadSamples.empty()) {
+            printRow("Load (imread)", loadSamples);
+        }
+        for (int stage = 0; stage < ColoringPageEngine::stageCount; ++stage) {
+            printRow(ColoringPageEngine::stageName(static_cast<ColoringPageEngine::Stage>(stage)), stageSamples[stage]);
+        }
+        printRow("Total", totalSamples);
+
+        std::printf("  threshold A/B\n");
+        printRow("OpenCV gray + threshold", thresholdComparison.openCvSamples);
+        printRow("Fused threshold", thresholdComparison.fusedSamples);
+        std::printf("  %-24s %10lld of %lld\n", "mismatched pixels", thresholdComparison.mismatchedPixels, thresholdComparison.pixels);
+
+        std::printf("  line extractors (grayscale + threshold, then whole page)\n");
+        for (const EdgeComparison& comparison : edgeComparisons) {
+            printRow(comparison.name.c_str(), comparison.edgeSamples);
+            printRow("  page total", comparison.totalSamples);
+        }
+    }
+
+    return 0;
+}